@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <map>
+#include <memory_resource>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -13,8 +14,14 @@ template <typename Key, typename Value>
 class ConcurrentMap {
 private:
     struct Bucket {
+        using allocator_type = std::pmr::polymorphic_allocator<Bucket>;
+
+        explicit Bucket(const allocator_type& allocator)
+            : map(allocator) {
+        }
+
         std::mutex mutex;
-        std::map<Key, Value> map;
+        std::pmr::map<Key, Value> map;
     };
  
 public:
@@ -30,8 +37,9 @@ public:
         }
     };
  
-    explicit ConcurrentMap(size_t bucket_count)
-        : buckets_(bucket_count) {
+    // buckets and their nodes come from resource, which must be safe to use from several threads
+    explicit ConcurrentMap(size_t bucket_count, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : buckets_(bucket_count, resource) {
     }
  
     Access operator[](const Key& key) {
@@ -39,8 +47,8 @@ public:
         return {key, bucket};
     }
  
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> result;
+    std::pmr::map<Key, Value> BuildOrdinaryMap() {
+        std::pmr::map<Key, Value> result(buckets_.get_allocator());
         for (auto& [mutex, map] : buckets_) {
             std::lock_guard g(mutex);
             result.insert(map.begin(), map.end());
@@ -49,5 +57,5 @@ public:
     }
  
 private:
-    std::vector<Bucket> buckets_;
+    std::pmr::vector<Bucket> buckets_;
 };
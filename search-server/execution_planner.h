@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+
+using namespace std;
+
+// Passed instead of execution::seq or execution::par, lets the server choose the execution of
+// every query from the length of the posting lists it is going to scan.
+struct AutoExecutionPolicy {
+};
+
+inline constexpr AutoExecutionPolicy auto_execution{};
+
+enum class QueryPlan {
+    SEQUENTIAL,
+    PARALLEL,
+    // reads impact-ordered postings only until no unseen document can reach the top
+    PRUNED,
+};
+
+// default crossover, below it the setup of the parallel path costs more than it saves
+const size_t PARALLEL_MIN_POSTINGS = 50000;
+
+// pruning pays off when few long lists dominate the query
+const size_t PRUNED_MAX_PLUS_WORDS = 2;
+
+struct PlannerThresholds {
+    // queries with at least this many postings run in parallel
+    size_t parallel_min_postings = PARALLEL_MIN_POSTINGS;
+    // queries with at most this many plus words and an impact-ordered list are pruned, 0 disables pruning
+    size_t pruned_max_plus_words = PRUNED_MAX_PLUS_WORDS;
+};
@@ -0,0 +1,135 @@
+#include "load_generator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <thread>
+
+namespace {
+
+const size_t WRITER_LIVE_DOCUMENTS = 64;
+
+vector<int64_t> RunClient(SearchServer& search_server, const vector<string>& queries, int client,
+                          const LoadConfig& config, chrono::steady_clock::time_point start, chrono::steady_clock::time_point stop) {
+    vector<int64_t> latencies;
+    const bool open_loop = config.target_qps > 0;
+    const auto interval = open_loop
+        ? chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(config.client_threads / config.target_qps))
+        : chrono::steady_clock::duration::zero();
+
+    // clients are staggered over one interval, so the load arrives evenly instead of in bursts
+    auto scheduled = start + interval * client / config.client_threads;
+    for (size_t i = queries.size() * client / config.client_threads; ; ++i) {
+        if (open_loop) {
+            this_thread::sleep_until(scheduled);
+        } else {
+            scheduled = chrono::steady_clock::now();
+        }
+        if (scheduled >= stop) {
+            break;
+        }
+        search_server.FindTopDocuments(queries[i % queries.size()]);
+        // in open loop the latency is measured from the scheduled send time, so a stalled
+        // server is charged for the queries that queued up behind it
+        latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - scheduled).count());
+        scheduled += interval;
+    }
+    return latencies;
+}
+
+size_t RunWriter(SearchServer& search_server, const vector<string>& documents, const LoadConfig& config,
+                 chrono::steady_clock::time_point stop) {
+    int next_id = 0;
+    if (search_server.begin() != search_server.end()) {
+        next_id = *prev(search_server.end()) + 1;
+    }
+    const auto interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0 / config.writer_ops_per_second));
+    deque<int> added_ids;
+    size_t writes = 0;
+    for (auto scheduled = chrono::steady_clock::now(); scheduled < stop && chrono::steady_clock::now() < stop; scheduled += interval) {
+        this_thread::sleep_until(scheduled);
+        if (added_ids.size() < WRITER_LIVE_DOCUMENTS) {
+            search_server.AddDocument(next_id, documents[writes % documents.size()], DocumentStatus::ACTUAL, {});
+            added_ids.push_back(next_id++);
+        } else {
+            search_server.RemoveDocument(added_ids.front());
+            added_ids.pop_front();
+        }
+        ++writes;
+    }
+    return writes;
+}
+
+chrono::nanoseconds Percentile(const vector<int64_t>& sorted_latencies, double p) {
+    if (sorted_latencies.empty()) {
+        return chrono::nanoseconds(0);
+    }
+    const size_t rank = static_cast<size_t>(ceil(p * sorted_latencies.size()));
+    return chrono::nanoseconds(sorted_latencies[max<size_t>(rank, 1) - 1]);
+}
+
+}  // namespace
+
+LoadReport RunLoad(SearchServer& search_server, const vector<string>& queries,
+                   const vector<string>& writer_documents, const LoadConfig& config) {
+    if (queries.empty() || config.client_threads <= 0) {
+        throw invalid_argument("Load needs queries and at least one client thread"s);
+    }
+    const bool with_writer = config.writer_ops_per_second > 0;
+    if (with_writer && writer_documents.empty()) {
+        throw invalid_argument("Writer thread needs documents to add"s);
+    }
+
+    const auto start = chrono::steady_clock::now();
+    const auto stop = start + config.duration;
+
+    vector<vector<int64_t>> client_latencies(config.client_threads);
+    vector<thread> clients;
+    for (int i = 0; i < config.client_threads; ++i) {
+        clients.emplace_back([&, i] {
+            client_latencies[i] = RunClient(search_server, queries, i, config, start, stop);
+        });
+    }
+    size_t writes = 0;
+    thread writer;
+    if (with_writer) {
+        writer = thread([&] {
+            writes = RunWriter(search_server, writer_documents, config, stop);
+        });
+    }
+    for (thread& client : clients) {
+        client.join();
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<int64_t> latencies;
+    for (const auto& client : client_latencies) {
+        latencies.insert(latencies.end(), client.begin(), client.end());
+    }
+    sort(latencies.begin(), latencies.end());
+
+    LoadReport report;
+    report.queries = latencies.size();
+    report.writes = writes;
+    report.seconds = seconds;
+    report.throughput = latencies.size() / seconds;
+    report.p50 = Percentile(latencies, 0.5);
+    report.p99 = Percentile(latencies, 0.99);
+    report.p999 = Percentile(latencies, 0.999);
+    report.max = Percentile(latencies, 1.0);
+    return report;
+}
+
+ostream& operator<<(ostream& out, const LoadReport& report) {
+    const auto to_us = [](chrono::nanoseconds ns) {
+        return chrono::duration<double, micro>(ns).count();
+    };
+    out << "queries = "s << report.queries << ", writes = "s << report.writes
+        << ", seconds = "s << report.seconds << ", qps = "s << report.throughput << endl
+        << "p50 = "s << to_us(report.p50) << " us, p99 = "s << to_us(report.p99)
+        << " us, p999 = "s << to_us(report.p999) << " us, max = "s << to_us(report.max) << " us"s;
+    return out;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "search_server.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct LoadConfig {
+    int client_threads = 4;
+    // 0 means closed loop: every client sends the next query as soon as the previous one returns
+    double target_qps = 0;
+    chrono::milliseconds duration = 10s;
+    // 0 disables the writer thread
+    double writer_ops_per_second = 0;
+};
+
+struct LoadReport {
+    size_t queries = 0;
+    size_t writes = 0;
+    double seconds = 0;
+    double throughput = 0;
+    chrono::nanoseconds p50{0};
+    chrono::nanoseconds p99{0};
+    chrono::nanoseconds p999{0};
+    chrono::nanoseconds max{0};
+};
+
+LoadReport RunLoad(SearchServer& search_server, const vector<string>& queries,
+                   const vector<string>& writer_documents, const LoadConfig& config);
+
+ostream& operator<<(ostream& out, const LoadReport& report);
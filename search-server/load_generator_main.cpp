@@ -0,0 +1,57 @@
+#include "load_generator.h"
+#include "read_input_functions.h"
+#include "search_metrics.h"
+#include "search_server.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+vector<string> ReadFileLines(const string& path) {
+    ifstream input(path);
+    if (!input) {
+        throw invalid_argument("Cannot open "s + path);
+    }
+    return ReadLines(input);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: "s << argv[0]
+             << " <corpus_file> <queries_file> [client_threads] [target_qps] [seconds] [writer_ops_per_second] [stop_words]"s
+             << endl;
+        return 1;
+    }
+    const vector<string> documents = ReadFileLines(argv[1]);
+    const vector<string> queries = ReadFileLines(argv[2]);
+
+    LoadConfig config;
+    if (argc > 3) {
+        config.client_threads = stoi(argv[3]);
+    }
+    if (argc > 4) {
+        config.target_qps = stod(argv[4]);
+    }
+    if (argc > 5) {
+        config.duration = chrono::duration_cast<chrono::milliseconds>(chrono::duration<double>(stod(argv[5])));
+    }
+    if (argc > 6) {
+        config.writer_ops_per_second = stod(argv[6]);
+    }
+
+    SearchServer search_server(argc > 7 ? string(argv[7]) : ""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {});
+    }
+    cout << "documents = "s << documents.size() << ", queries = "s << queries.size()
+         << ", clients = "s << config.client_threads
+         << (config.target_qps > 0 ? ", open loop at "s + to_string(config.target_qps) + " qps"s : ", closed loop"s)
+         << endl;
+    cout << RunLoad(search_server, queries, documents, config) << endl;
+    cout << search_server.GetMemoryStats();
+#ifdef SEARCH_SERVER_METRICS
+    cout << CollectQueryMetrics();
+#endif
+}
@@ -0,0 +1,38 @@
+#include "memory_accounting.h"
+#include <numeric>
+#include <string>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+size_t MemoryStats::GetTotal() const {
+    return accumulate(bytes.begin(), bytes.end(), size_t{0});
+}
+
+ostream& operator<<(ostream& out, const MemoryStats& stats) {
+    static const array<string, MEMORY_CATEGORY_COUNT> names = {
+        "postings"s, "word_frequencies"s, "documents"s, "document_ids"s, "storage"s, "index_versions"s,
+    };
+    for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+        out << names[i] << " = "s << stats.bytes[i] << " bytes"s << endl;
+    }
+    out << "total = "s << stats.GetTotal() << " bytes"s << endl;
+    return out;
+}
+
+MemoryStats MemoryAccounting::GetStats() const {
+    MemoryStats stats;
+    for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+        stats.bytes[i] = bytes_[i].load(memory_order_relaxed);
+    }
+    return stats;
+}
+
+size_t GetAllocationSize(void* pointer, size_t requested) {
+#if defined(__GLIBC__)
+    // usable part of the chunk plus its size field
+    return malloc_usable_size(pointer) + sizeof(size_t);
+#else
+    return requested + 2 * sizeof(void*);
+#endif
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+enum class MemoryCategory {
+    // words and posting lists of every segment
+    POSTINGS,
+    // per-document word -> frequency maps
+    WORD_FREQUENCIES,
+    // document ids, ratings, statuses and removal marks of every segment
+    DOCUMENTS,
+    DOCUMENT_IDS,
+    // texts of added documents
+    STORAGE,
+    // index versions and segment headers
+    INDEX_VERSIONS,
+    COUNT,
+};
+
+const size_t MEMORY_CATEGORY_COUNT = static_cast<size_t>(MemoryCategory::COUNT);
+
+struct MemoryStats {
+    array<size_t, MEMORY_CATEGORY_COUNT> bytes{};
+
+    size_t Get(MemoryCategory category) const {
+        return bytes[static_cast<size_t>(category)];
+    }
+
+    size_t GetTotal() const;
+};
+
+ostream& operator<<(ostream& out, const MemoryStats& stats);
+
+class MemoryAccounting {
+public:
+    atomic<int64_t>* GetCounter(MemoryCategory category) {
+        return &bytes_[static_cast<size_t>(category)];
+    }
+
+    MemoryStats GetStats() const;
+
+private:
+    array<atomic<int64_t>, MEMORY_CATEGORY_COUNT> bytes_{};
+};
+
+// bytes the allocator really holds for the block, including its header
+size_t GetAllocationSize(void* pointer, size_t requested);
+
+// Adds the real size of every block to a counter. A default constructed allocator counts nothing.
+template <typename T>
+class CountingAllocator {
+public:
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    explicit CountingAllocator(atomic<int64_t>* counter)
+        : counter_(counter) {
+    }
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other)
+        : counter_(other.GetCounter()) {
+    }
+
+    T* allocate(size_t n) {
+        void* pointer = malloc(n * sizeof(T));
+        if (!pointer) {
+            throw bad_alloc();
+        }
+        if (counter_) {
+            counter_->fetch_add(GetAllocationSize(pointer, n * sizeof(T)), memory_order_relaxed);
+        }
+        return static_cast<T*>(pointer);
+    }
+
+    void deallocate(T* pointer, size_t n) {
+        if (counter_) {
+            counter_->fetch_sub(GetAllocationSize(pointer, n * sizeof(T)), memory_order_relaxed);
+        }
+        free(pointer);
+    }
+
+    atomic<int64_t>* GetCounter() const {
+        return counter_;
+    }
+
+private:
+    atomic<int64_t>* counter_ = nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs) {
+    return lhs.GetCounter() == rhs.GetCounter();
+}
+
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs) {
+    return !(lhs == rhs);
+}
+
+template <typename T>
+using CountedVector = vector<T, CountingAllocator<T>>;
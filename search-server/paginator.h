@@ -1,5 +1,8 @@
 #pragma once
+#include <cstddef>
 #include <iostream>
+#include <iterator>
+#include <utility>
 #include <vector>
 
 using namespace std;
@@ -72,4 +75,78 @@ private:
 template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
     return Paginator(begin(c), end(c), page_size);
-}
\ No newline at end of file
+}
+
+// Fetches pages on demand. source(previous, page_size) receives the last item of the previous page,
+// null for the first one, and returns the next page; a short page is the last one.
+template <typename Item, typename PageSource>
+class LazyPaginator {
+public:
+    class Iterator {
+    public:
+        using iterator_category = input_iterator_tag;
+        using value_type = vector<Item>;
+        using difference_type = ptrdiff_t;
+        using pointer = const vector<Item>*;
+        using reference = const vector<Item>&;
+
+        Iterator() = default;
+
+        explicit Iterator(const LazyPaginator* paginator)
+            : paginator_(paginator)
+            , page_(paginator->source_(nullptr, paginator->page_size_)) {
+        }
+
+        reference operator*() const {
+            return page_;
+        }
+
+        pointer operator->() const {
+            return &page_;
+        }
+
+        Iterator& operator++() {
+            if (page_.size() < paginator_->page_size_) {
+                page_.clear();
+            } else {
+                page_ = paginator_->source_(&page_.back(), paginator_->page_size_);
+            }
+            return *this;
+        }
+
+        // only an exhausted iterator compares equal to end()
+        bool operator==(const Iterator& other) const {
+            return page_.empty() && other.page_.empty();
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const LazyPaginator* paginator_ = nullptr;
+        vector<Item> page_;
+    };
+
+    LazyPaginator(PageSource source, size_t page_size)
+        : source_(move(source))
+        , page_size_(page_size) {
+    }
+
+    Iterator begin() const {
+        return page_size_ > 0 ? Iterator(this) : Iterator();
+    }
+
+    Iterator end() const {
+        return {};
+    }
+
+private:
+    PageSource source_;
+    size_t page_size_;
+};
+
+template <typename Item, typename PageSource>
+auto PaginateLazily(PageSource source, size_t page_size) {
+    return LazyPaginator<Item, PageSource>(move(source), page_size);
+}
@@ -24,3 +24,15 @@ std::list<Document> ProcessQueriesJoined(
     return documents;
 }
 
+std::vector<std::vector<Document>> ProcessQueries(
+    const ShardedSearchServer& search_server,
+    const std::vector<std::string>& queries)
+{
+    std::vector<std::vector<Document>> documents_lists(queries.size());
+    transform(execution::par,
+              queries.begin(), queries.end(),
+              documents_lists.begin(), [&search_server](const std::string_view query) {
+                  return search_server.FindTopDocuments(query);
+              });
+    return documents_lists;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "search_server.h"
+#include "sharded_search_server.h"
 #include "document.h"
 #include <algorithm>
 #include <functional>
@@ -15,3 +16,7 @@ std::vector<std::vector<Document>> ProcessQueries(
 std::list<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
+
+std::vector<std::vector<Document>> ProcessQueries(
+    const ShardedSearchServer& search_server,
+    const std::vector<std::string>& queries);
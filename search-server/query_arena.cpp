@@ -0,0 +1,115 @@
+#include "query_arena.h"
+#include <algorithm>
+#include <cstdint>
+
+QueryArena::Scope::Scope()
+    : arena_(ForThisThread())
+{
+    ++arena_.depth_;
+}
+
+QueryArena::Scope::~Scope() {
+    if (--arena_.depth_ == 0) {
+        arena_.Reset();
+    }
+}
+
+QueryArena::SharedScope::SharedScope()
+    : arena_(ForThisThread())
+{
+    ++arena_.shared_depth_;
+}
+
+QueryArena::SharedScope::~SharedScope() {
+    --arena_.shared_depth_;
+}
+
+QueryArena& QueryArena::ForThisThread() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+pmr::memory_resource* QueryArena::GetResource() {
+    QueryArena& arena = ForThisThread();
+    if (arena.depth_ == 0) {
+        return pmr::new_delete_resource();
+    }
+    if (arena.shared_depth_ > 0) {
+        return &arena.locked_;
+    }
+    return &*arena.resource_;
+}
+
+QueryArena::QueryArena()
+    : buffer_(QUERY_ARENA_INITIAL_SIZE)
+    , resource_(in_place, buffer_.data(), buffer_.size(), &overflow_)
+    , locked_(&*resource_)
+{
+}
+
+void QueryArena::Reset() {
+    const size_t usage = overflow_.allocated > 0 ? buffer_.size() + overflow_.allocated : GetBufferUsage();
+    resource_->release();
+    overflow_.allocated = 0;
+    size_t size = buffer_.size();
+    if (usage > buffer_.size()) {
+        // the next query of the same size fits in the buffer, unless it is over the cap
+        size = min(usage, QUERY_ARENA_MAX_RETAINED_SIZE);
+        peak_usage_ = 0;
+        small_queries_ = 0;
+    } else if (buffer_.size() > QUERY_ARENA_INITIAL_SIZE) {
+        // a buffer grown by a few large queries is given back once the queries after them are small
+        peak_usage_ = max(peak_usage_, usage);
+        if (peak_usage_ > buffer_.size() / 2) {
+            peak_usage_ = 0;
+            small_queries_ = 0;
+        } else if (++small_queries_ == QUERY_ARENA_SHRINK_PERIOD) {
+            size = max(peak_usage_, QUERY_ARENA_INITIAL_SIZE);
+            peak_usage_ = 0;
+            small_queries_ = 0;
+        }
+    }
+    if (size != buffer_.size()) {
+        buffer_ = vector<byte>(size);
+        resource_.emplace(buffer_.data(), buffer_.size(), &overflow_);
+    }
+}
+
+size_t QueryArena::GetBufferUsage() {
+    // a monotonic resource does not report its usage, but the next byte it hands out follows the last one
+    const auto next = reinterpret_cast<uintptr_t>(resource_->allocate(1, 1));
+    const auto first = reinterpret_cast<uintptr_t>(buffer_.data());
+    return next >= first && next < first + buffer_.size() ? next - first : buffer_.size();
+}
+
+void* QueryArena::OverflowResource::do_allocate(size_t bytes, size_t alignment) {
+    allocated += bytes;
+    return pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void QueryArena::OverflowResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
+
+bool QueryArena::OverflowResource::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+QueryArena::LockedResource::LockedResource(pmr::memory_resource* upstream)
+    : upstream_(upstream)
+{
+}
+
+void* QueryArena::LockedResource::do_allocate(size_t bytes, size_t alignment) {
+    lock_guard guard(mutex_);
+    return upstream_->allocate(bytes, alignment);
+}
+
+void QueryArena::LockedResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    lock_guard guard(mutex_);
+    upstream_->deallocate(pointer, bytes, alignment);
+}
+
+bool QueryArena::LockedResource::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+using namespace std;
+
+// first buffer of every thread arena; it grows to the largest recent query
+const size_t QUERY_ARENA_INITIAL_SIZE = 64 * 1024;
+
+// the buffer never grows past this size, larger queries take the rest from the heap every time
+const size_t QUERY_ARENA_MAX_RETAINED_SIZE = 8 * 1024 * 1024;
+
+// after this many queries in a row using at most half of the buffer it shrinks to the largest of them
+const int QUERY_ARENA_SHRINK_PERIOD = 1024;
+
+// A per-thread monotonic buffer for temporaries of one query. Memory is handed out by bumping
+// a pointer and released all at once when the outermost Scope of the thread ends, so a query
+// that fits in the buffer makes no calls to the global allocator.
+class QueryArena {
+public:
+    // Marks one query. Containers taking memory from the arena must be destroyed before their scope.
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        QueryArena& arena_;
+    };
+
+    // While alive, GetResource() returns a locked resource, so the arena can be used from the
+    // workers of a parallel algorithm, including by queries they start on this thread.
+    class SharedScope {
+    public:
+        SharedScope();
+        ~SharedScope();
+
+        SharedScope(const SharedScope&) = delete;
+        SharedScope& operator=(const SharedScope&) = delete;
+
+    private:
+        QueryArena& arena_;
+    };
+
+    static QueryArena& ForThisThread();
+
+    // the arena resource inside a Scope, the global heap outside of any
+    static pmr::memory_resource* GetResource();
+
+private:
+    // forwards to the heap and remembers how much the buffer was short of
+    class OverflowResource : public pmr::memory_resource {
+    public:
+        size_t allocated = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const pmr::memory_resource& other) const noexcept override;
+    };
+
+    class LockedResource : public pmr::memory_resource {
+    public:
+        explicit LockedResource(pmr::memory_resource* upstream);
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const pmr::memory_resource& other) const noexcept override;
+
+        pmr::memory_resource* upstream_;
+        mutex mutex_;
+    };
+
+    QueryArena();
+
+    void Reset();
+
+    // bytes of the buffer taken by the current query, the whole buffer once it overflowed
+    size_t GetBufferUsage();
+
+    vector<byte> buffer_;
+    OverflowResource overflow_;
+    optional<pmr::monotonic_buffer_resource> resource_;
+    LockedResource locked_;
+    int depth_ = 0;
+    int shared_depth_ = 0;
+    // the largest usage since the buffer was last resized or a query used more than half of it
+    size_t peak_usage_ = 0;
+    int small_queries_ = 0;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include "document.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// Copies share one flag, so a token handed to a query can be cancelled from another thread.
+class CancellationToken {
+public:
+    void Cancel() {
+        cancelled_->store(true, memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return cancelled_->load(memory_order_relaxed);
+    }
+
+private:
+    shared_ptr<atomic<bool>> cancelled_ = make_shared<atomic<bool>>(false);
+};
+
+struct QueryBudget {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    CancellationToken token;
+
+    bool IsExhausted() const {
+        return token.IsCancelled() || chrono::steady_clock::now() >= deadline;
+    }
+};
+
+struct TopDocumentsResult {
+    vector<Document> documents;
+    // the budget ran out before all postings were scanned, documents are the best found so far
+    bool truncated = false;
+};
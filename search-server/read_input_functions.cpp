@@ -1,8 +1,12 @@
 #include "read_input_functions.h"
 
 string ReadLine() {
+    return ReadLine(cin);
+}
+
+string ReadLine(istream& input) {
     string s;
-    getline(cin, s);
+    getline(input, s);
     return s;
 }
 
@@ -11,4 +15,14 @@ int ReadLineWithNumber() {
     cin >> result;
     ReadLine();
     return result;
-}
\ No newline at end of file
+}
+
+vector<string> ReadLines(istream& input) {
+    vector<string> lines;
+    for (string line; getline(input, line);) {
+        if (!line.empty()) {
+            lines.push_back(move(line));
+        }
+    }
+    return lines;
+}
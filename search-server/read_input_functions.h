@@ -1,9 +1,14 @@
 #pragma once
 #include <string>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
 string ReadLine();
 
-int ReadLineWithNumber();
\ No newline at end of file
+string ReadLine(istream& input);
+
+int ReadLineWithNumber();
+
+vector<string> ReadLines(istream& input);
@@ -0,0 +1,124 @@
+#include "search_metrics.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace metrics_detail {
+
+namespace {
+
+struct Registry {
+    mutex slots_mutex;
+    // deque keeps slot addresses stable; slots of finished threads are handed to new ones
+    deque<ThreadSlot> slots;
+    vector<ThreadSlot*> free_slots;
+};
+
+Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+struct SlotOwner {
+    ThreadSlot* slot;
+
+    SlotOwner() {
+        Registry& registry = GetRegistry();
+        lock_guard guard(registry.slots_mutex);
+        if (registry.free_slots.empty()) {
+            slot = &registry.slots.emplace_back();
+        } else {
+            slot = registry.free_slots.back();
+            registry.free_slots.pop_back();
+        }
+    }
+
+    ~SlotOwner() {
+        Registry& registry = GetRegistry();
+        lock_guard guard(registry.slots_mutex);
+        registry.free_slots.push_back(slot);
+    }
+};
+
+}  // namespace
+
+ThreadSlot& AcquireLocalSlot() {
+    thread_local SlotOwner owner;
+    return *owner.slot;
+}
+
+uint64_t ClockOverheadNs() {
+    static const uint64_t overhead = [] {
+        // the median, so that a preempted read does not inflate it
+        array<uint64_t, 1001> samples;
+        for (uint64_t& sample : samples) {
+            const auto start = chrono::steady_clock::now();
+            sample = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        }
+        nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }();
+    return overhead;
+}
+
+}  // namespace metrics_detail
+
+chrono::nanoseconds PhaseHistogram::Percentile(double p) const {
+    if (count == 0) {
+        return chrono::nanoseconds(0);
+    }
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(p * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return chrono::nanoseconds(i == 0 ? 0 : (uint64_t{1} << min<size_t>(i, 63)) - 1);
+        }
+    }
+    return chrono::nanoseconds(0);
+}
+
+QueryMetrics CollectQueryMetrics() {
+    using namespace metrics_detail;
+    QueryMetrics result;
+    Registry& registry = GetRegistry();
+    lock_guard guard(registry.slots_mutex);
+    for (const ThreadSlot& slot : registry.slots) {
+        for (size_t i = 0; i < QUERY_COUNTER_COUNT; ++i) {
+            result.counters[i] += slot.counters[i].load(memory_order_relaxed);
+        }
+        for (size_t phase = 0; phase < QUERY_PHASE_COUNT; ++phase) {
+            PhaseHistogram& histogram = result.phases[phase];
+            for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) {
+                const uint64_t count = slot.buckets[phase][i].load(memory_order_relaxed);
+                histogram.buckets[i] += count;
+                histogram.count += count;
+            }
+            histogram.total_ns += slot.total_ns[phase].load(memory_order_relaxed);
+        }
+    }
+    return result;
+}
+
+ostream& operator<<(ostream& out, const QueryMetrics& metrics) {
+    static const array<string, QUERY_COUNTER_COUNT> counter_names = {
+        "queries"s, "postings_scanned"s, "predicate_calls"s, "documents_scored"s, "pruned_queries"s,
+    };
+    static const array<string, QUERY_PHASE_COUNT> phase_names = {
+        "parse"s, "posting_traversal"s, "predicate"s, "minus_filtering"s, "top_k"s, "result_build"s,
+    };
+    for (size_t i = 0; i < QUERY_COUNTER_COUNT; ++i) {
+        out << counter_names[i] << " = "s << metrics.counters[i] << endl;
+    }
+    for (size_t i = 0; i < QUERY_PHASE_COUNT; ++i) {
+        const PhaseHistogram& histogram = metrics.phases[i];
+        out << phase_names[i] << ": count = "s << histogram.count
+            << ", total = "s << histogram.total_ns / 1000 << " us"s
+            << ", p50 <= "s << histogram.Percentile(0.5).count() << " ns"s
+            << ", p99 <= "s << histogram.Percentile(0.99).count() << " ns"s
+            << ", p999 <= "s << histogram.Percentile(0.999).count() << " ns"s << endl;
+    }
+    return out;
+}
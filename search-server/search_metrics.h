@@ -0,0 +1,177 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+// Hooks compile to nothing unless SEARCH_SERVER_METRICS is defined.
+// Phases may nest: POSTING_TRAVERSAL includes the PREDICATE time spent inside it.
+// PREDICATE runs once per posting and is sampled: its count is the number of timed calls
+// and its total is extrapolated to all of them.
+enum class QueryPhase {
+    PARSE,
+    POSTING_TRAVERSAL,
+    PREDICATE,
+    MINUS_FILTERING,
+    TOP_K,
+    RESULT_BUILD,
+    COUNT,
+};
+
+enum class QueryCounter {
+    QUERIES,
+    POSTINGS_SCANNED,
+    PREDICATE_CALLS,
+    DOCUMENTS_SCORED,
+    // queries answered from the heads of impact-ordered postings
+    PRUNED_QUERIES,
+    COUNT,
+};
+
+const size_t QUERY_PHASE_COUNT = static_cast<size_t>(QueryPhase::COUNT);
+const size_t QUERY_COUNTER_COUNT = static_cast<size_t>(QueryCounter::COUNT);
+// bucket i holds durations in [2^(i-1), 2^i) nanoseconds
+const size_t HISTOGRAM_BUCKET_COUNT = 64;
+// one call in this many of a sampled phase reads the clock
+const uint64_t PHASE_SAMPLE_PERIOD = 64;
+
+struct PhaseHistogram {
+    array<uint64_t, HISTOGRAM_BUCKET_COUNT> buckets{};
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+
+    // upper bound of the bucket that holds the p-th quantile
+    chrono::nanoseconds Percentile(double p) const;
+};
+
+struct QueryMetrics {
+    array<uint64_t, QUERY_COUNTER_COUNT> counters{};
+    array<PhaseHistogram, QUERY_PHASE_COUNT> phases{};
+
+    uint64_t Get(QueryCounter counter) const {
+        return counters[static_cast<size_t>(counter)];
+    }
+
+    const PhaseHistogram& Get(QueryPhase phase) const {
+        return phases[static_cast<size_t>(phase)];
+    }
+};
+
+// Sums the per-thread slots of every thread that has ever recorded a metric.
+QueryMetrics CollectQueryMetrics();
+
+ostream& operator<<(ostream& out, const QueryMetrics& metrics);
+
+namespace metrics_detail {
+
+// Each slot is written only by its owning thread, so updates are plain relaxed load/store
+// pairs; atomics are there only to let CollectQueryMetrics read concurrently.
+struct ThreadSlot {
+    array<atomic<uint64_t>, QUERY_COUNTER_COUNT> counters{};
+    array<array<atomic<uint64_t>, HISTOGRAM_BUCKET_COUNT>, QUERY_PHASE_COUNT> buckets{};
+    array<atomic<uint64_t>, QUERY_PHASE_COUNT> total_ns{};
+};
+
+ThreadSlot& AcquireLocalSlot();
+
+// what an empty interval between two clock reads measures, calibrated once per process
+uint64_t ClockOverheadNs();
+
+// the slot is looked up once per thread, later calls read a plain thread-local pointer
+inline ThreadSlot& LocalSlot() {
+    thread_local ThreadSlot* slot = nullptr;
+    if (!slot) {
+        slot = &AcquireLocalSlot();
+    }
+    return *slot;
+}
+
+inline void Add(atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+inline size_t BucketIndex(uint64_t ns) {
+#if defined(__GNUC__)
+    return ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+#else
+    size_t index = 0;
+    for (; ns != 0; ns >>= 1) {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+inline void Count(QueryCounter counter, uint64_t delta) {
+    Add(LocalSlot().counters[static_cast<size_t>(counter)], delta);
+}
+
+inline void Record(size_t phase, uint64_t ns, uint64_t weight) {
+    ThreadSlot& slot = LocalSlot();
+    Add(slot.buckets[phase][min(BucketIndex(ns), HISTOGRAM_BUCKET_COUNT - 1)], 1);
+    Add(slot.total_ns[phase], ns * weight);
+}
+
+class PhaseTimer {
+public:
+    explicit PhaseTimer(QueryPhase phase)
+        : phase_(static_cast<size_t>(phase)) {
+    }
+
+    ~PhaseTimer() {
+        Record(phase_, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_).count(), 1);
+    }
+
+private:
+    const size_t phase_;
+    const chrono::steady_clock::time_point start_ = chrono::steady_clock::now();
+};
+
+// Times every PHASE_SAMPLE_PERIOD-th call of the thread, the rest cost an increment. A sampled
+// call can be cheaper than reading the clock, so the cost of the reads is subtracted.
+class SampledPhaseTimer {
+public:
+    explicit SampledPhaseTimer(QueryPhase phase)
+        : phase_(static_cast<size_t>(phase))
+        , sampled_(++CallCount() % PHASE_SAMPLE_PERIOD == 0) {
+        if (sampled_) {
+            start_ = chrono::steady_clock::now();
+        }
+    }
+
+    ~SampledPhaseTimer() {
+        if (sampled_) {
+            const uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_).count();
+            const uint64_t overhead = ClockOverheadNs();
+            Record(phase_, ns > overhead ? ns - overhead : 0, PHASE_SAMPLE_PERIOD);
+        }
+    }
+
+private:
+    static uint64_t& CallCount() {
+        thread_local uint64_t count = 0;
+        return count;
+    }
+
+    const size_t phase_;
+    const bool sampled_;
+    chrono::steady_clock::time_point start_;
+};
+
+}  // namespace metrics_detail
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+#ifdef SEARCH_SERVER_METRICS
+#define METRICS_PHASE(phase) metrics_detail::PhaseTimer METRICS_CONCAT(metricsPhase, __LINE__)(QueryPhase::phase)
+#define METRICS_SAMPLED_PHASE(phase) metrics_detail::SampledPhaseTimer METRICS_CONCAT(metricsPhase, __LINE__)(QueryPhase::phase)
+#define METRICS_COUNT(counter, delta) metrics_detail::Count(QueryCounter::counter, (delta))
+#else
+#define METRICS_PHASE(phase)
+#define METRICS_SAMPLED_PHASE(phase)
+#define METRICS_COUNT(counter, delta)
+#endif
@@ -10,23 +10,61 @@ SearchServer::SearchServer(string_view stop_words_view)
 {
 }
 
+SearchServer::~SearchServer() {
+    {
+        lock_guard guard(write_mutex_);
+        stopping_ = true;
+    }
+    merge_requested_cv_.notify_one();
+    if (merge_thread_.joinable()) {
+        merge_thread_.join();
+    }
+}
+
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    {
+        const auto index = AcquireIndex();
+        // removed documents keep their memory until a merge drops them; compacting for a few of
+        // them would rewrite the whole index on every insert
+        if (ExceedsMemoryBudget(*index, document)
+            && GetRemovedSize(*index) >= memory_budget_ * COMPACTION_MIN_REMOVED_SHARE) {
+            Compact();
+        }
+    }
+    lock_guard guard(write_mutex_);
+    if ((document_id < 0) || (document_ids_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
     if (!IsValidWord(document)) {
         throw invalid_argument("invalid document"s);
     }
-    storage.emplace_back(document.data());
-    const auto words = SplitIntoWordsNoStop(storage.back());
-
+    if (ExceedsMemoryBudget(*AcquireIndex(), document)) {
+        throw length_error("Memory budget exceeded"s);
+    }
+    auto stored = allocate_shared<StoredDocument>(MakeAllocator<StoredDocument>(MemoryCategory::STORAGE), StoredDocument{
+        StoredText(document, MakeAllocator<char>(MemoryCategory::STORAGE)),
+        Segment::WordFrequencies(MakeAllocator<Segment::WordFrequencies::value_type>(MemoryCategory::WORD_FREQUENCIES)),
+    });
+    const auto words = SplitIntoWordsNoStop(stored->text);
     const double inv_word_count = 1.0 / words.size();
     for (const string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        freqs_in_docs_[document_id][word] += inv_word_count;
+        stored->word_freqs[word] += inv_word_count;
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    shared_ptr<const Segment::WordFrequencies> word_freqs(stored, &stored->word_freqs);
+    write_buffer_->AddDocument(document_id, DocumentData{ ComputeAverageRating(ratings), status }, move(word_freqs));
+
+    auto next = CopyIndex(*AcquireIndex());
+    next->segments_.back().segment = allocate_shared<Segment>(MakeAllocator<Segment>(MemoryCategory::INDEX_VERSIONS), write_buffer_);
+    ++next->document_count_;
+    const bool sealed = write_buffer_->GetDocumentCount() == write_buffer_->GetCapacity();
+    if (sealed) {
+        SealWriteBuffer(*next);
+    }
+    PublishIndex(move(next));
     document_ids_.insert(document_id);
+    if (sealed) {
+        RequestMerge();
+    }
 }
 
 
@@ -40,71 +78,170 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const TermStatistics& statistics) const {
+    return RankDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+        }, {&statistics, nullptr}).documents;
+}
+
+TopDocumentsResult SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const QueryBudget& budget) const {
+    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+        }, budget);
+}
+
+TermStatistics SearchServer::GetTermStatistics(string_view raw_query) const {
+    QueryArena::Scope arena_scope;
+    const auto index = AcquireIndex();
+    auto query = ParseQuery(raw_query, false);
+    ExpandPrefixes(*index, query);
+    TermStatistics statistics;
+    statistics.document_count = index->document_count_;
+    for (const string_view word : query.plus_words) {
+        statistics.document_freqs.emplace(word, ComputeDocumentFreq(*index, word));
+    }
+    return statistics;
+}
+
+size_t SearchServer::EstimateQueryPostings(string_view raw_query) const {
+    QueryArena::Scope arena_scope;
+    const auto index = AcquireIndex();
+    auto query = ParseQuery(raw_query, false);
+    ExpandPrefixes(*index, query);
+    return CountPostings(*index, query);
+}
+
+QueryPlan SearchServer::PlanQuery(string_view raw_query) const {
+    QueryArena::Scope arena_scope;
+    const auto index = AcquireIndex();
+    auto query = ParseQuery(raw_query, false);
+    ExpandPrefixes(*index, query);
+    return PlanQuery(*index, query);
+}
+
+void SearchServer::SetPlannerThresholds(const PlannerThresholds& thresholds) {
+    parallel_min_postings_ = thresholds.parallel_min_postings;
+    pruned_max_plus_words_ = thresholds.pruned_max_plus_words;
+}
+
+PlannerThresholds SearchServer::GetPlannerThresholds() const {
+    return {parallel_min_postings_, pruned_max_plus_words_};
+}
+
+PlannerThresholds SearchServer::CalibratePlanner(const vector<string>& sample_queries) {
+    struct Sample {
+        size_t postings;
+        double sequential_seconds;
+        double parallel_seconds;
+    };
+    auto measure = [](const auto& run) {
+        // the best of a few runs filters out scheduling noise
+        double best = numeric_limits<double>::max();
+        for (int i = 0; i < 3; ++i) {
+            const auto start = chrono::steady_clock::now();
+            run();
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+    vector<Sample> samples;
+    for (const string& query : sample_queries) {
+        samples.push_back({EstimateQueryPostings(query),
+                           measure([&] { FindTopDocuments(execution::seq, query); }),
+                           measure([&] { FindTopDocuments(execution::par, query); })});
+    }
+    sort(samples.begin(), samples.end(), [](const Sample& lhs, const Sample& rhs) {
+        return lhs.postings < rhs.postings;
+    });
+
+    // samples before the split run sequentially, the rest in parallel
+    double cost = 0.0;
+    for (const Sample& sample : samples) {
+        cost += sample.parallel_seconds;
+    }
+    PlannerThresholds thresholds = GetPlannerThresholds();
+    if (!samples.empty()) {
+        thresholds.parallel_min_postings = 0;
+    }
+    double best_cost = cost;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        cost += samples[i].sequential_seconds - samples[i].parallel_seconds;
+        const bool can_split = i + 1 == samples.size() || samples[i + 1].postings != samples[i].postings;
+        if (can_split && cost < best_cost) {
+            best_cost = cost;
+            thresholds.parallel_min_postings = i + 1 == samples.size()
+                ? numeric_limits<size_t>::max()
+                : samples[i + 1].postings;
+        }
+    }
+    SetPlannerThresholds(thresholds);
+    return thresholds;
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return AcquireIndex()->document_count_;
 }
 
-set<int>::const_iterator SearchServer::begin() const {
+SearchServer::DocumentIdSet::const_iterator SearchServer::begin() const {
     return document_ids_.begin();
 }
 
-set<int>::const_iterator SearchServer::end() const {
+SearchServer::DocumentIdSet::const_iterator SearchServer::end() const {
     return document_ids_.end();
 }
 
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const map<string_view, double> empty_map_;
-    if (count(document_ids_.begin(), document_ids_.end(), document_id) == 0) {
+const Segment::WordFrequencies& SearchServer::GetWordFrequencies(int document_id) const {
+    static const Segment::WordFrequencies empty_map_;
+    const auto index = AcquireIndex();
+    const auto location = FindDocument(*index, document_id);
+    if (!location) {
         return empty_map_;
     }
-    return freqs_in_docs_.at(document_id);
+    return location->entry->segment->GetWordFrequencies(location->index);
 }
 
 MatchReturn SearchServer::MatchDocument(string_view raw_query, int document_id) const {
-    if (!IsIdCorrect(document_id)) {
+    QueryArena::Scope arena_scope;
+    const auto index = AcquireIndex();
+    const auto location = FindDocument(*index, document_id);
+    if (!location) {
         throw out_of_range("неверный id"s);
     } 
     if (!IsValidWord(raw_query)) {
         throw invalid_argument("некорректный запрос"s);
     }
     auto query = ParseQuery(raw_query, false);
+    // the same capped expansion as in ranking, so only words FindTopDocuments scores are reported
+    ExpandPrefixes(*index, query);
     
+    const Segment& segment = *location->entry->segment;
+    const auto& word_freqs = segment.GetWordFrequencies(location->index);
     vector<string_view> matched_words;
     for (const string_view word : query.minus_words) {
-        if (freqs_in_docs_.at(document_id).count(word)) {
-            return { matched_words, documents_.at(document_id).status };
+        if (word_freqs.count(word)) {
+            return { matched_words, segment.GetDocumentData(location->index).status };
         }
     }
     for (const string_view word : query.plus_words) {
-        string w {word};
-        if (freqs_in_docs_.at(document_id).count(w)) {
-            matched_words.push_back(word);
+        // the key of the document, not the query text, so every matched word lives as long as the document
+        const auto it = word_freqs.find(word);
+        if (it != word_freqs.end()) {
+            matched_words.push_back(it->first);
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, segment.GetDocumentData(location->index).status };
 }
 
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (count(document_ids_.begin(), document_ids_.end(), document_id) == 0) {
-        return;
-    }
-    document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
-    documents_.erase(documents_.find(document_id));
-    freqs_in_docs_.erase(freqs_in_docs_.find(document_id));
-    for (auto& [word, info] : word_to_document_freqs_) {
-        auto it = info.find(document_id);
-        if (it != info.end()) {
-            info.erase(it);
-        }
-    }
+    RemoveDocument(execution::seq, document_id);
 }
 
 
 
 bool SearchServer::IsStopWord(const string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(const string_view word) {
@@ -122,10 +259,6 @@ bool SearchServer::IsValidWords(const vector<string_view>& words) const {
     return true;
 }
 
-bool SearchServer::IsIdCorrect(int id) const {
-    return documents_.count(id) != 0;
-}
-
 vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
     vector<string_view> words;
     for (const string_view word : SplitIntoWords(text)) {
@@ -158,19 +291,27 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) con
         is_minus = true;
         word = word.substr(1);
     }
+    bool is_prefix = false;
+    if (!word.empty() && word.back() == '*') {
+        is_prefix = true;
+        word.remove_suffix(1);
+    }
     if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
         throw invalid_argument("Query word "s + text.data() + " is invalid"s);
     }
 
-    return { word, is_minus, IsStopWord(word) };
+    return { word, is_minus, !is_prefix && IsStopWord(word), is_prefix };
 }
 
 
 SearchServer::Query SearchServer::ParseQuery(string_view text, bool flag) const {
-    Query result;
-    for (const string_view word : SplitIntoWords(text)) {
+    pmr::memory_resource* resource = QueryArena::GetResource();
+    Query result(resource);
+    for (const string_view word : SplitIntoWords(text, resource)) {
         const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
+        if (query_word.is_prefix) {
+            (query_word.is_minus ? result.minus_prefixes : result.plus_prefixes).push_back(query_word.data);
+        } else if (!query_word.is_stop) {
             if (query_word.is_minus) { result.minus_words.push_back(query_word.data);
             }
             else {
@@ -192,41 +333,394 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, bool flag) const
     return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+void SearchServer::ExpandPrefixes(const Index& index, Query& query, const TermStatistics* statistics) const {
+    if (query.plus_prefixes.empty() && query.minus_prefixes.empty()) {
+        return;
+    }
+    auto expand = [&index](const pmr::vector<string_view>& prefixes, size_t limit, pmr::vector<string_view>& words,
+                           const TermStatistics* statistics) {
+        for (const string_view prefix : prefixes) {
+            pmr::vector<string_view> expansion(QueryArena::GetResource());
+            if (statistics) {
+                // words of other shards are in the statistics too, the limit keeps the first ones of them all
+                const auto& document_freqs = statistics->document_freqs;
+                for (auto it = document_freqs.lower_bound(prefix);
+                     it != document_freqs.end() && string_view(it->first).substr(0, prefix.size()) == prefix; ++it) {
+                    if (it->second > 0) {
+                        expansion.push_back(it->first);
+                    }
+                }
+            } else {
+                for (const SegmentEntry& entry : index.segments_) {
+                    entry.segment->AppendWordsWithPrefix(prefix, expansion);
+                }
+                sort(expansion.begin(), expansion.end());
+                expansion.erase(unique(expansion.begin(), expansion.end()), expansion.end());
+                if (expansion.size() > limit) {
+                    // a word left only by removed documents must not take the place of a live one until the next merge
+                    size_t live_count = 0;
+                    for (size_t i = 0; i < expansion.size() && live_count < limit; ++i) {
+                        if (HasLiveDocument(index, expansion[i])) {
+                            expansion[live_count++] = expansion[i];
+                        }
+                    }
+                    expansion.resize(live_count);
+                }
+            }
+            if (expansion.size() > limit) {
+                expansion.resize(limit);
+            }
+            words.insert(words.end(), expansion.begin(), expansion.end());
+        }
+        sort(words.begin(), words.end());
+        words.erase(unique(words.begin(), words.end()), words.end());
+    };
+    expand(query.plus_prefixes, prefix_expansion_limit_, query.plus_words, statistics);
+    // a capped exclusion would let excluded documents through, and documents added since the first
+    // round must be excluded as well, so minus prefixes always expand over the index
+    expand(query.minus_prefixes, numeric_limits<size_t>::max(), query.minus_words, nullptr);
+    query.plus_prefixes.clear();
+    query.minus_prefixes.clear();
+}
+
+bool SearchServer::HasLiveDocument(const Index& index, const string_view word) {
+    return any_of(index.segments_.begin(), index.segments_.end(), [word](const SegmentEntry& entry) {
+        const auto postings = entry.segment->GetPostings(word);
+        return any_of(postings.begin(), postings.end(), [&entry](const Posting& posting) {
+            return !entry.IsDeleted(posting.document_index);
+        });
+    });
+}
+
+size_t SearchServer::ComputeDocumentFreq(const Index& index, const string_view word) {
+    size_t document_freq = 0;
+    for (const SegmentEntry& entry : index.segments_) {
+        const auto postings = entry.segment->GetPostings(word);
+        if (entry.deleted_count == 0) {
+            document_freq += postings.size();
+        } else {
+            document_freq += count_if(postings.begin(), postings.end(), [&entry](const Posting& posting) {
+                return !entry.IsDeleted(posting.document_index);
+            });
+        }
+    }
+    return document_freq;
+}
+
+SearchServer::Exclusions SearchServer::BuildExclusions(const Index& index, const Query& query) {
+    METRICS_PHASE(MINUS_FILTERING);
+    pmr::memory_resource* resource = QueryArena::GetResource();
+    Exclusions exclusions(resource);
+    if (query.minus_words.empty()) {
+        return exclusions;
+    }
+    exclusions.resize(index.segments_.size());
+    for (size_t i = 0; i < index.segments_.size(); ++i) {
+        const Segment& segment = *index.segments_[i].segment;
+        for (const string_view word : query.minus_words) {
+            const auto postings = segment.GetPostings(word);
+            if (postings.size() > 0 && exclusions[i].empty()) {
+                exclusions[i].resize(segment.GetDocumentCount());
+            }
+            for (const Posting& posting : postings) {
+                exclusions[i][posting.document_index] = true;
+            }
+        }
+    }
+    return exclusions;
+}
+
+size_t SearchServer::CountPostings(const Index& index, const Query& query) {
+    // removed documents are counted too, they are scanned all the same
+    size_t postings = 0;
+    for (const SegmentEntry& entry : index.segments_) {
+        for (const auto* words : {&query.plus_words, &query.minus_words}) {
+            for (const string_view word : *words) {
+                postings += entry.segment->GetPostings(word).size();
+            }
+        }
+    }
+    return postings;
+}
+
+QueryPlan SearchServer::PlanQuery(const Index& index, const Query& query) const {
+    if (!query.plus_words.empty() && query.plus_words.size() <= pruned_max_plus_words_) {
+        for (const SegmentEntry& entry : index.segments_) {
+            for (const string_view word : query.plus_words) {
+                if (entry.segment->HasImpactPostings(word)) {
+                    return QueryPlan::PRUNED;
+                }
+            }
+        }
+    }
+    return CountPostings(index, query) >= parallel_min_postings_ ? QueryPlan::PARALLEL : QueryPlan::SEQUENTIAL;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(const Index& index, size_t document_freq) {
+    return log(index.document_count_ * 1.0 / document_freq);
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(const TermStatistics& statistics, const string_view word, size_t document_freq) {
+    const auto it = statistics.document_freqs.find(word);
+    if (it != statistics.document_freqs.end() && it->second > 0) {
+        document_freq = it->second;
+    }
+    return log(max(static_cast<size_t>(statistics.document_count), document_freq) * 1.0 / document_freq);
+}
+
+optional<SearchServer::DocumentLocation> SearchServer::FindDocument(const Index& index, int document_id) {
+    for (const SegmentEntry& entry : index.segments_) {
+        const int document_index = entry.segment->FindDocument(document_id);
+        if (document_index >= 0 && !entry.IsDeleted(document_index)) {
+            return DocumentLocation{&entry, static_cast<uint32_t>(document_index)};
+        }
+    }
+    return nullopt;
 }
 
 void SearchServer::RemoveDocument(execution::sequenced_policy, int document_id) {
-    if (count(document_ids_.begin(), document_ids_.end(), document_id) == 0) {
+    lock_guard guard(write_mutex_);
+    if (document_ids_.count(document_id) == 0) {
         return;
     }
-    document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
-    documents_.erase(documents_.find(document_id));
-    freqs_in_docs_.erase(freqs_in_docs_.find(document_id));
-    for (auto& [word, info] : word_to_document_freqs_) {
-        auto it = info.find(document_id);
-        if (it != info.end()) {
-            info.erase(it);
+    auto next = CopyIndex(*AcquireIndex());
+    const auto location = *FindDocument(*next, document_id);
+    SegmentEntry& entry = next->segments_[location.entry - next->segments_.data()];
+    const auto allocator = MakeAllocator<Segment::Tombstones>(MemoryCategory::DOCUMENTS);
+    auto deleted = entry.deleted
+        ? allocate_shared<Segment::Tombstones>(allocator, *entry.deleted)
+        : allocate_shared<Segment::Tombstones>(allocator, memory_);
+    deleted->Set(location.index);
+    entry.deleted = move(deleted);
+    ++entry.deleted_count;
+    entry.deleted_size += EstimateDocumentSize(entry.segment->GetWordFrequencies(location.index));
+    --next->document_count_;
+    const bool mostly_deleted = entry.deleted_count * 2 > entry.segment->GetDocumentCount();
+    PublishIndex(move(next));
+    document_ids_.erase(document_id);
+    if (mostly_deleted) {
+        RequestMerge();
+    }
+}
+
+void SearchServer::RemoveDocument(execution::parallel_policy, int document_id) {
+    RemoveDocument(execution::seq, document_id);
+}
+
+void SearchServer::Compact() {
+    while (MergeSegments(true)) {
+    }
+}
+
+MemoryStats SearchServer::GetMemoryStats() const {
+    return memory_.GetStats();
+}
+
+void SearchServer::SetMemoryBudget(size_t bytes) {
+    memory_budget_ = bytes;
+}
+
+void SearchServer::SetPrefixExpansionLimit(size_t limit) {
+    prefix_expansion_limit_ = limit;
+}
+
+shared_ptr<SearchServer::Index> SearchServer::MakeEmptyIndex() {
+    auto index = allocate_shared<Index>(MakeAllocator<Index>(MemoryCategory::INDEX_VERSIONS),
+                                        Index{CountedVector<SegmentEntry>(MakeAllocator<SegmentEntry>(MemoryCategory::INDEX_VERSIONS))});
+    index->segments_.push_back(StartWriteBuffer());
+    return index;
+}
+
+shared_ptr<SearchServer::Index> SearchServer::CopyIndex(const Index& index) {
+    return allocate_shared<Index>(MakeAllocator<Index>(MemoryCategory::INDEX_VERSIONS), index);
+}
+
+SearchServer::SegmentEntry SearchServer::MakeSegmentEntry(Segment segment) {
+    return SegmentEntry{allocate_shared<Segment>(MakeAllocator<Segment>(MemoryCategory::INDEX_VERSIONS), move(segment))};
+}
+
+SearchServer::SegmentEntry SearchServer::StartWriteBuffer() {
+    write_buffer_ = allocate_shared<Segment::Buffer>(MakeAllocator<Segment::Buffer>(MemoryCategory::INDEX_VERSIONS),
+                                                     memory_, SEGMENT_BUFFER_DOCUMENT_COUNT);
+    return SegmentEntry{allocate_shared<Segment>(MakeAllocator<Segment>(MemoryCategory::INDEX_VERSIONS), write_buffer_)};
+}
+
+void SearchServer::SealWriteBuffer(Index& index) {
+    const SegmentEntry& buffer = index.segments_.back();
+    Segment sealed = Segment::Merge(memory_, {{buffer.segment.get(), buffer.deleted.get()}});
+    if (sealed.GetDocumentCount() > 0) {
+        index.segments_.back() = MakeSegmentEntry(move(sealed));
+    } else {
+        index.segments_.pop_back();
+    }
+    index.segments_.push_back(StartWriteBuffer());
+}
+
+bool SearchServer::ExceedsMemoryBudget(const Index& index, string_view document) const {
+    const size_t budget = memory_budget_;
+    if (budget == 0) {
+        return false;
+    }
+    // an upper bound: the document itself and the compact copy of the write buffer made when the document seals it
+    const Segment& buffer = *index.segments_.back().segment;
+    const size_t buffer_size = (buffer.GetDocumentCount() + 1)
+        * (sizeof(int) + sizeof(DocumentData) + sizeof(shared_ptr<const Segment::WordFrequencies>))
+        + buffer.GetPostingCount() * (sizeof(string_view) + sizeof(uint32_t) + sizeof(Posting));
+    const size_t required = EstimateDocumentSize(document.size(), count(document.begin(), document.end(), ' ') + 1) + buffer_size;
+    return memory_.GetStats().GetTotal() + required > budget;
+}
+
+size_t SearchServer::EstimateDocumentSize(size_t text_size, size_t word_count) {
+    // the text, a forward map node and a posting per word
+    const size_t word_size = sizeof(Segment::WordFrequencies::value_type) + 4 * sizeof(void*)
+        + sizeof(string_view) + sizeof(uint32_t) + sizeof(Posting);
+    return sizeof(StoredDocument) + text_size + word_count * word_size;
+}
+
+size_t SearchServer::EstimateDocumentSize(const Segment::WordFrequencies& word_freqs) {
+    // stop words and repeats are not in the map, the text is estimated from the distinct words
+    size_t text_size = 0;
+    for (const auto& [word, _] : word_freqs) {
+        text_size += word.size() + 1;
+    }
+    return EstimateDocumentSize(text_size, word_freqs.size());
+}
+
+size_t SearchServer::GetRemovedSize(const Index& index) {
+    size_t size = 0;
+    for (const SegmentEntry& entry : index.segments_) {
+        size += entry.deleted_size;
+    }
+    return size;
+}
+
+shared_ptr<const SearchServer::Index> SearchServer::AcquireIndex() const {
+    return atomic_load(&index_);
+}
+
+void SearchServer::PublishIndex(shared_ptr<const Index> index) {
+    atomic_store(&index_, move(index));
+}
+
+void SearchServer::RequestMerge() {
+    if (!merge_thread_.joinable()) {
+        merge_thread_ = thread(&SearchServer::RunBackgroundMerges, this);
+    }
+    merge_requested_ = true;
+    merge_requested_cv_.notify_one();
+}
+
+void SearchServer::RunBackgroundMerges() {
+    unique_lock lock(write_mutex_);
+    while (true) {
+        merge_requested_cv_.wait(lock, [this] {
+            return merge_requested_ || stopping_;
+        });
+        if (stopping_) {
+            return;
+        }
+        merge_requested_ = false;
+        lock.unlock();
+        while (MergeSegments(false)) {
         }
+        lock.lock();
     }
 }
 
+vector<size_t> SearchServer::SelectMergeCandidates(const Index& index) {
+    // tiered policy: sealed segments whose live sizes fall into the same power of
+    // SEGMENT_MERGE_FACTOR are merged together, a mostly deleted segment is rewritten alone
+    map<int, vector<size_t>> tiers;
+    for (size_t i = 0; i + 1 < index.segments_.size(); ++i) {
+        const SegmentEntry& entry = index.segments_[i];
+        const size_t document_count = entry.segment->GetDocumentCount();
+        if (entry.deleted_count * 2 > document_count) {
+            return {i};
+        }
+        int tier = 0;
+        for (size_t size = SEGMENT_BUFFER_DOCUMENT_COUNT * SEGMENT_MERGE_FACTOR;
+             document_count - entry.deleted_count >= size; size *= SEGMENT_MERGE_FACTOR) {
+            ++tier;
+        }
+        auto& segments = tiers[tier];
+        segments.push_back(i);
+        if (segments.size() == SEGMENT_MERGE_FACTOR) {
+            return segments;
+        }
+    }
+    return {};
+}
 
-void SearchServer::RemoveDocument(execution::parallel_policy, int document_id) {
-    vector<string_view> words_to_remove(freqs_in_docs_[document_id].size());
-
-    transform(execution::par,
-        freqs_in_docs_[document_id].begin(),
-        freqs_in_docs_[document_id].end(),
-        words_to_remove.begin(),
-        [](const auto& word_freq) { return word_freq.first; });
-
-    for_each(execution::par,
-        words_to_remove.begin(),
-        words_to_remove.end(),
-        [&](const string_view word) { word_to_document_freqs_[word].erase(document_id); });
-
-    document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
-    documents_.erase(document_id);
-    freqs_in_docs_.erase(document_id);
+bool SearchServer::MergeSegments(bool merge_all) {
+    lock_guard merge_guard(merge_mutex_);
+    shared_ptr<const Index> snapshot;
+    vector<size_t> candidates;
+    {
+        lock_guard guard(write_mutex_);
+        if (stopping_) {
+            return false;
+        }
+        snapshot = AcquireIndex();
+        if (merge_all) {
+            const SegmentEntry& buffer = snapshot->segments_.back();
+            if (buffer.segment->GetDocumentCount() > 0) {
+                auto next = CopyIndex(*snapshot);
+                SealWriteBuffer(*next);
+                snapshot = next;
+                PublishIndex(move(next));
+            }
+            const size_t sealed_count = snapshot->segments_.size() - 1;
+            if (sealed_count > 1 || (sealed_count == 1 && snapshot->segments_.front().deleted_count > 0)) {
+                candidates.resize(sealed_count);
+                iota(candidates.begin(), candidates.end(), 0);
+            }
+        } else {
+            candidates = SelectMergeCandidates(*snapshot);
+        }
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+
+    vector<Segment::Part> parts;
+    for (const size_t i : candidates) {
+        parts.push_back({snapshot->segments_[i].segment.get(), snapshot->segments_[i].deleted.get()});
+    }
+    SegmentEntry merged = MakeSegmentEntry(Segment::Merge(memory_, parts));
+
+    lock_guard guard(write_mutex_);
+    auto next = CopyIndex(*AcquireIndex());
+    CountedVector<SegmentEntry> segments(next->segments_.get_allocator());
+    Segment::Tombstones merged_deleted(memory_);
+    for (const SegmentEntry& entry : next->segments_) {
+        const auto candidate = find_if(candidates.begin(), candidates.end(), [&](size_t i) {
+            return snapshot->segments_[i].segment == entry.segment;
+        });
+        if (candidate == candidates.end()) {
+            segments.push_back(entry);
+            continue;
+        }
+        // documents removed while the merge was running are still marked only in the old segment
+        const SegmentEntry& merged_from = snapshot->segments_[*candidate];
+        if (entry.deleted_count == merged_from.deleted_count) {
+            continue;
+        }
+        for (uint32_t i = 0; i < entry.segment->GetDocumentCount(); ++i) {
+            if (entry.IsDeleted(i) && !merged_from.IsDeleted(i)) {
+                merged_deleted.Set(merged.segment->FindDocument(entry.segment->GetDocumentId(i)));
+                ++merged.deleted_count;
+                merged.deleted_size += EstimateDocumentSize(entry.segment->GetWordFrequencies(i));
+            }
+        }
+    }
+    if (merged.deleted_count > 0) {
+        merged.deleted = allocate_shared<Segment::Tombstones>(
+            MakeAllocator<Segment::Tombstones>(MemoryCategory::DOCUMENTS), move(merged_deleted));
+    }
+    if (merged.segment->GetDocumentCount() > merged.deleted_count) {
+        segments.insert(segments.end() - 1, move(merged));
+    }
+    next->segments_ = move(segments);
+    PublishIndex(move(next));
+    return true;
 }
@@ -12,20 +12,68 @@
 #include "document.h"
 #include <execution>
 #include <string_view>
-#include <deque>
+#include <unordered_set>
 #include <exception>
 #include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <future>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <tuple>
 #include "concurrent_map.h"
+#include "execution_planner.h"
+#include "memory_accounting.h"
+#include "paginator.h"
+#include "query_arena.h"
+#include "search_metrics.h"
+#include "segment.h"
+#include "stop_words.h"
+#include "query_budget.h"
 
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
 const double EPSILON = 1e-6;
 
+const size_t SEGMENT_BUFFER_DOCUMENT_COUNT = 512;
+
+const size_t SEGMENT_MERGE_FACTOR = 4;
+
+// over the memory budget, AddDocument compacts the index only once removed documents hold this share of the budget
+const double COMPACTION_MIN_REMOVED_SHARE = 0.1;
+
+// how many postings are scanned between two checks of a QueryBudget
+const size_t POSTING_BLOCK_SIZE = 1024;
+
+// default number of index words a plus prefix term such as "comput*" expands into
+const size_t PREFIX_EXPANSION_LIMIT = 64;
+
 using MatchReturn = tuple<vector<string_view>, DocumentStatus>;
 
+// document count and document frequencies of the plus words of one query
+struct TermStatistics {
+    int document_count = 0;
+    map<string, size_t, less<>> document_freqs;
+};
+
+// Strict total order of results: relevance rounded to EPSILON and rating descending, then id ascending.
+// Relevances are rounded rather than compared by difference, so the order stays transitive and a page
+// window or a cursor taken from one page agrees with the full ranking.
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    // relevance is never negative, so the cast rounds it; unlike llround it is inlined into the sort
+    const auto lhs_relevance = static_cast<long long>(lhs.relevance * (1.0 / EPSILON) + 0.5);
+    const auto rhs_relevance = static_cast<long long>(rhs.relevance * (1.0 / EPSILON) + 0.5);
+    return tie(rhs_relevance, rhs.rating, lhs.id) < tie(lhs_relevance, lhs.rating, rhs.id);
+}
+
 class SearchServer {
 public:
+    using DocumentIdSet = set<int, less<int>, CountingAllocator<int>>;
 
     template <typename StringContainer>
     SearchServer(const StringContainer& stop_words);
@@ -34,6 +82,8 @@ public:
 
     explicit SearchServer(string_view stop_words_view);
 
+    ~SearchServer();
+
     void AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings);
 
     template <typename DocumentPredicate>
@@ -42,7 +92,39 @@ public:
     vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status) const;
 
     vector<Document> FindTopDocuments(string_view raw_query) const;
+
+    // ranks with IDF taken from statistics gathered over a larger corpus, e.g. every shard
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status, const TermStatistics& statistics) const;
+
+    TermStatistics GetTermStatistics(string_view raw_query) const;
+
+    // stops scanning postings once the budget is exhausted and returns the best documents found so far
+    template <typename DocumentPredicate>
+    TopDocumentsResult FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate, const QueryBudget& budget) const;
+
+    TopDocumentsResult FindTopDocuments(string_view raw_query, DocumentStatus status, const QueryBudget& budget) const;
+
+    // Executor is any callable that accepts function<void()> and runs it, e.g. on a thread pool.
+    // The server must outlive the returned future.
+    template <typename Executor, typename DocumentPredicate>
+    future<TopDocumentsResult> FindTopDocumentsAsync(Executor& executor, string raw_query, DocumentPredicate document_predicate, QueryBudget budget) const;
+
+    template <typename Executor>
+    future<TopDocumentsResult> FindTopDocumentsAsync(Executor& executor, string raw_query, DocumentStatus status, QueryBudget budget) const;
     
+    // results ranked offset .. offset + limit in IsMoreRelevant order, selected without sorting the rest
+    template <typename DocumentPredicate>
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate, size_t offset, size_t limit) const;
+
+    // the next limit results ranked after the given one, usually the last document of the previous page
+    template <typename DocumentPredicate>
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate, const Document& after, size_t limit) const;
+
+    // Iterates over all results page by page, each page is a separate query resumed from the previous one.
+    // The server must outlive the paginator.
+    template <typename DocumentPredicate>
+    auto PaginateTopDocuments(string raw_query, DocumentPredicate document_predicate, size_t page_size) const;
+
     template <typename ExecutionPolicy, typename DocumentPredicate>
     vector<Document> FindTopDocuments(ExecutionPolicy &policy, string_view raw_query, DocumentPredicate document_predicate) const;
 
@@ -52,37 +134,154 @@ public:
     template <typename ExecutionPolicy>
     vector<Document> FindTopDocuments(ExecutionPolicy &policy, string_view raw_query) const;
 
+    // postings the query would scan, the estimate the auto_execution planner decides on
+    size_t EstimateQueryPostings(string_view raw_query) const;
+
+    QueryPlan PlanQuery(string_view raw_query) const;
+
+    void SetPlannerThresholds(const PlannerThresholds& thresholds);
+
+    PlannerThresholds GetPlannerThresholds() const;
+
+    // times every sample query both ways and sets the crossover with the least total time
+    PlannerThresholds CalibratePlanner(const vector<string>& sample_queries);
+
     int GetDocumentCount() const;
 
-    set<int>::const_iterator begin() const;
+    // iteration over document ids is not synchronized with AddDocument/RemoveDocument
+    DocumentIdSet::const_iterator begin() const;
 
-    set<int>::const_iterator end() const;
+    DocumentIdSet::const_iterator end() const;
 
+    // the matched words point into the document text and stay valid until the document is removed
     MatchReturn MatchDocument(string_view raw_query, int document_id) const;
     
     template <typename ExecutionPolicy>
     MatchReturn MatchDocument(ExecutionPolicy &policy, string_view raw_query, int document_id) const;
 
-    const map<string_view, double>& GetWordFrequencies(int document_id) const;
+    // the reference stays valid until the document is removed
+    const Segment::WordFrequencies& GetWordFrequencies(int document_id) const;
 
     void RemoveDocument(int document_id);
     void RemoveDocument(execution::sequenced_policy, int document_id);
     void RemoveDocument(execution::parallel_policy, int document_id);
 
+    // seals the write buffer and merges every segment into one, dropping removed documents
+    void Compact();
+
+    // bytes held by the index, including versions still pinned by running queries
+    MemoryStats GetMemoryStats() const;
+
+    // AddDocument throws length_error once a document could take the index over the budget; 0 disables the check
+    void SetMemoryBudget(size_t bytes);
+
+    // a plus prefix term is expanded into at most limit words, the first ones in lexicographic order;
+    // minus prefix terms are always expanded in full
+    void SetPrefixExpansionLimit(size_t limit);
 
 private:
     struct QueryWord {
         string_view data;
         bool is_minus;
         bool is_stop;
+        bool is_prefix;
     };
 
-    const set<string, less<>> stop_words_;
-    map<string_view, map<int, double>> word_to_document_freqs_;
-    map<int, DocumentData> documents_;
-    set<int> document_ids_;
-    map<int, map<string_view, double>> freqs_in_docs_;
-    deque<string> storage;
+    struct SegmentEntry {
+        shared_ptr<const Segment> segment;
+        // documents removed after the segment was built; null while there are none
+        shared_ptr<const Segment::Tombstones> deleted;
+        size_t deleted_count = 0;
+        // estimated memory of the removed documents, freed when a merge drops them
+        size_t deleted_size = 0;
+
+        bool IsDeleted(uint32_t index) const {
+            return deleted && deleted->Test(index);
+        }
+    };
+
+    // An immutable version of the index. Readers pin the current version for the whole query,
+    // writers publish a new one that shares every segment they did not touch.
+    struct Index {
+        // sealed segments followed by a view of the write buffer
+        CountedVector<SegmentEntry> segments_;
+        int document_count_ = 0;
+    };
+
+    struct DocumentLocation {
+        const SegmentEntry* entry;
+        uint32_t index;
+    };
+
+    using StoredText = basic_string<char, char_traits<char>, CountingAllocator<char>>;
+
+    // Word frequencies point into the text, so both are freed together once
+    // no segment of a live index version holds the document.
+    struct StoredDocument {
+        StoredText text;
+        Segment::WordFrequencies word_freqs;
+    };
+
+    const StopWords stop_words_;
+    // every allocation of the index is counted here, so it is declared before the index
+    MemoryAccounting memory_;
+    atomic<size_t> memory_budget_{0};
+    atomic<size_t> prefix_expansion_limit_{PREFIX_EXPANSION_LIMIT};
+    atomic<size_t> parallel_min_postings_{PARALLEL_MIN_POSTINGS};
+    atomic<size_t> pruned_max_plus_words_{PRUNED_MAX_PLUS_WORDS};
+    // appended to under write_mutex_, set up by MakeEmptyIndex, so it is declared before the index
+    shared_ptr<Segment::Buffer> write_buffer_;
+    // accessed only through atomic_load/atomic_store; a version is freed with its last reader
+    shared_ptr<const Index> index_ = MakeEmptyIndex();
+    // guards publishing of index_ and the members below
+    mutex write_mutex_;
+    DocumentIdSet document_ids_{MakeAllocator<int>(MemoryCategory::DOCUMENT_IDS)};
+    // held for the whole merge, so merges never run concurrently
+    mutex merge_mutex_;
+    condition_variable merge_requested_cv_;
+    bool merge_requested_ = false;
+    bool stopping_ = false;
+    thread merge_thread_;
+
+    template <typename T>
+    CountingAllocator<T> MakeAllocator(MemoryCategory category) {
+        return CountingAllocator<T>(memory_.GetCounter(category));
+    }
+
+    shared_ptr<Index> MakeEmptyIndex();
+
+    shared_ptr<Index> CopyIndex(const Index& index);
+
+    SegmentEntry MakeSegmentEntry(Segment segment);
+
+    // starts a new write buffer and returns its empty view
+    SegmentEntry StartWriteBuffer();
+
+    // replaces the write buffer view, the last segment of index, with its compact layout
+    void SealWriteBuffer(Index& index);
+
+    bool ExceedsMemoryBudget(const Index& index, string_view document) const;
+
+    // an upper bound of the memory a document takes in a sealed segment
+    static size_t EstimateDocumentSize(size_t text_size, size_t word_count);
+
+    static size_t EstimateDocumentSize(const Segment::WordFrequencies& word_freqs);
+
+    static size_t GetRemovedSize(const Index& index);
+
+    shared_ptr<const Index> AcquireIndex() const;
+
+    void PublishIndex(shared_ptr<const Index> index);
+
+    void RequestMerge();
+
+    void RunBackgroundMerges();
+
+    bool MergeSegments(bool merge_all);
+
+    static vector<size_t> SelectMergeCandidates(const Index& index);
+
+    static optional<DocumentLocation> FindDocument(const Index& index, int document_id);
 
     bool IsStopWord(const string_view word) const;
 
@@ -97,88 +296,218 @@ private:
     QueryWord ParseQueryWord(const string_view text) const;
 
     struct Query {
-        vector<string_view> plus_words;
-        vector<string_view> minus_words;
-    };
+        explicit Query(pmr::memory_resource* resource)
+            : plus_words(resource)
+            , minus_words(resource)
+            , plus_prefixes(resource)
+            , minus_prefixes(resource) {
+        }
 
-    bool IsIdCorrect(int id) const;
+        pmr::vector<string_view> plus_words;
+        pmr::vector<string_view> minus_words;
+        // terms written as "prefix*", without the asterisk
+        pmr::vector<string_view> plus_prefixes;
+        pmr::vector<string_view> minus_prefixes;
+    };
 
+    // allocates from the query arena of the calling thread
     Query ParseQuery(string_view text, bool flag) const;
 
-    double ComputeWordInverseDocumentFreq(const string_view word) const;
+    // Replaces prefix terms with the matching words of the index. Given the statistics of the first
+    // round, plus prefixes expand into the words ranked there, so both rounds score the same terms.
+    void ExpandPrefixes(const Index& index, Query& query, const TermStatistics* statistics = nullptr) const;
+
+    Query ParseMeasuredQuery(const Index& index, string_view text, const TermStatistics* statistics = nullptr) const {
+        METRICS_PHASE(PARSE);
+        auto query = ParseQuery(text, false);
+        ExpandPrefixes(index, query, statistics);
+        return query;
+    }
+
+    template <typename DocumentPredicate>
+    static bool MeasuredPredicate(DocumentPredicate& document_predicate, int document_id, const DocumentData& document_data) {
+        METRICS_COUNT(PREDICATE_CALLS, 1);
+        METRICS_SAMPLED_PHASE(PREDICATE);
+        return document_predicate(document_id, document_data.status, document_data.rating);
+    }
+
+    static size_t ComputeDocumentFreq(const Index& index, const string_view word);
+
+    // stops at the first posting of a document that is not removed
+    static bool HasLiveDocument(const Index& index, const string_view word);
+
+    // documents containing a minus word, one bitset per segment of the index, left empty for segments without them
+    using Exclusions = pmr::vector<pmr::vector<bool>>;
+
+    static Exclusions BuildExclusions(const Index& index, const Query& query);
+
+    static bool IsExcluded(const Exclusions& exclusions, size_t segment, uint32_t document_index) {
+        return !exclusions.empty() && !exclusions[segment].empty() && exclusions[segment][document_index];
+    }
+
+    static size_t CountPostings(const Index& index, const Query& query);
+
+    QueryPlan PlanQuery(const Index& index, const Query& query) const;
 
+    static double ComputeWordInverseDocumentFreq(const Index& index, size_t document_freq);
+
+    // documents added after the statistics were gathered fall back to the document frequency of the index
+    static double ComputeWordInverseDocumentFreq(const TermStatistics& statistics, const string_view word, size_t document_freq);
+
+    struct RankOptions {
+        const TermStatistics* statistics = nullptr;
+        const QueryBudget* budget = nullptr;
+    };
+
+    template <typename DocumentPredicate>
+    TopDocumentsResult RankDocuments(string_view raw_query, DocumentPredicate document_predicate, const RankOptions& options) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindRankWindow(string_view raw_query, DocumentPredicate document_predicate,
+                                    const Document* after, size_t offset, size_t limit) const;
+
+    // the candidates live in the query arena, callers copy out what they return
     template <typename DocumentPredicate>
-    vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    pmr::vector<Document> FindAllDocuments(const Index& index, const Query& query, DocumentPredicate document_predicate,
+                                           const RankOptions& options = {}, bool* truncated = nullptr) const;
     
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    vector<Document> FindAllDocuments(ExecutionPolicy &policy, const Query& query, DocumentPredicate document_predicate) const;
+    pmr::vector<Document> FindAllDocuments(ExecutionPolicy &policy, const Index& index, const Query& query, DocumentPredicate document_predicate) const;
+
+    // status, when known, restricts impact-ordered postings to one status group
+    template <typename DocumentPredicate>
+    vector<Document> FindTopDocumentsAuto(string_view raw_query, DocumentPredicate document_predicate, optional<DocumentStatus> status) const;
+
+    // Threshold algorithm over impact-ordered postings. Returns a superset of the documents that
+    // FindAllDocuments would put at the top: everything within EPSILON of the last top relevance.
+    template <typename DocumentPredicate>
+    pmr::vector<Document> FindPrunedDocuments(const Index& index, const Query& query, DocumentPredicate document_predicate,
+                                              optional<DocumentStatus> status) const;
 
 };
 
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    : stop_words_(stop_words)
 {
-    if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
+    if (!all_of(stop_words_.begin(), stop_words_.end(), [](const string& word) {
+            return IsValidWord(word);
+        })) {
         throw invalid_argument("Some of stop words are invalid"s);
     }
 }
 
 
 template <typename DocumentPredicate>
-vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-    map<int, double> document_to_relevance;
-    for (const string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+pmr::vector<Document> SearchServer::FindAllDocuments(const Index& index, const Query& query, DocumentPredicate document_predicate,
+                                                    const RankOptions& options, bool* truncated) const {
+    pmr::memory_resource* resource = QueryArena::GetResource();
+    pmr::map<int, double> document_to_relevance(resource);
+    bool out_of_budget = false;
+    // minus words are applied in full even when out of budget, partial results must not contain them
+    const Exclusions exclusions = BuildExclusions(index, query);
+    {
+        METRICS_PHASE(POSTING_TRAVERSAL);
+        for (const string_view word : query.plus_words) {
+            if (out_of_budget) {
+                break;
+            }
+            const size_t document_freq = ComputeDocumentFreq(index, word);
+            if (document_freq == 0) {
+                continue;
+            }
+            const double inverse_document_freq = options.statistics
+                ? ComputeWordInverseDocumentFreq(*options.statistics, word, document_freq)
+                : ComputeWordInverseDocumentFreq(index, document_freq);
+            for (size_t segment = 0; segment < index.segments_.size(); ++segment) {
+                const SegmentEntry& entry = index.segments_[segment];
+                const auto postings = entry.segment->GetPostings(word);
+                for (auto block = postings.begin(); block != postings.end();) {
+                    if (options.budget && options.budget->IsExhausted()) {
+                        out_of_budget = true;
+                        break;
+                    }
+                    const auto block_end = static_cast<size_t>(postings.end() - block) > POSTING_BLOCK_SIZE
+                        ? block + POSTING_BLOCK_SIZE
+                        : postings.end();
+                    METRICS_COUNT(POSTINGS_SCANNED, block_end - block);
+                    for (; block != block_end; ++block) {
+                        const auto [document_index, term_freq] = *block;
+                        if (entry.IsDeleted(document_index) || IsExcluded(exclusions, segment, document_index)) {
+                            continue;
+                        }
+                        const int document_id = entry.segment->GetDocumentId(document_index);
+                        const auto& document_data = entry.segment->GetDocumentData(document_index);
+                        if (MeasuredPredicate(document_predicate, document_id, document_data)) {
+                            document_to_relevance[document_id] += term_freq * inverse_document_freq;
+                        }
+                    }
+                }
+                if (out_of_budget) {
+                    break;
+                }
             }
         }
     }
-
-    for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
+    if (truncated) {
+        *truncated = out_of_budget;
     }
+    METRICS_COUNT(DOCUMENTS_SCORED, document_to_relevance.size());
 
-    vector<Document> matched_documents;
+    METRICS_PHASE(RESULT_BUILD);
+    pmr::vector<Document> matched_documents(resource);
+    matched_documents.reserve(document_to_relevance.size());
     for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+        const auto location = *FindDocument(index, document_id);
+        matched_documents.push_back({ document_id, relevance, location.entry->segment->GetDocumentData(location.index).rating });
     }
     return matched_documents;
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-    vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy &policy, const Query& query, DocumentPredicate document_predicate) const {
-    if (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>) {
-        return FindAllDocuments(query, document_predicate);
+    pmr::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy &policy, const Index& index, const Query& query, DocumentPredicate document_predicate) const {
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>) {
+        return FindAllDocuments(index, query, document_predicate);
     } else {
-        ConcurrentMap<int, double> document_to_relevance(15);
-        for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
-            }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for_each(policy, word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(), [&](auto data) {
-            const auto& document_data = documents_.at(data.first);
-            if (document_predicate(data.first, document_data.status, document_data.rating)) {
-                document_to_relevance[data.first].ref_to_value += data.second * inverse_document_freq;
-            }});});
-
-        vector<Document> matched_documents;
-        for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap())
+        // built before the workers start and only read by them
+        const Exclusions exclusions = BuildExclusions(index, query);
+        // buckets are filled from the workers, so they take the arena through a lock
+        QueryArena::SharedScope shared_arena;
+        ConcurrentMap<int, double> document_to_relevance(15, QueryArena::GetResource());
         {
+            METRICS_PHASE(POSTING_TRAVERSAL);
+            for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](string_view word) {
+                const size_t document_freq = ComputeDocumentFreq(index, word);
+                if (document_freq == 0) {
+                    return;
+                }
+                const double inverse_document_freq = ComputeWordInverseDocumentFreq(index, document_freq);
+                for (size_t segment = 0; segment < index.segments_.size(); ++segment) {
+                    const SegmentEntry& entry = index.segments_[segment];
+                    const auto postings = entry.segment->GetPostings(word);
+                    METRICS_COUNT(POSTINGS_SCANNED, postings.size());
+                    for_each(policy, postings.begin(), postings.end(), [&](const Posting& posting) {
+                    if (entry.IsDeleted(posting.document_index) || IsExcluded(exclusions, segment, posting.document_index)) {
+                        return;
+                    }
+                    const int document_id = entry.segment->GetDocumentId(posting.document_index);
+                    const auto& document_data = entry.segment->GetDocumentData(posting.document_index);
+                    if (MeasuredPredicate(document_predicate, document_id, document_data)) {
+                        document_to_relevance[document_id].ref_to_value += posting.term_freq * inverse_document_freq;
+                    }});
+                }});
+        }
+
+        METRICS_PHASE(RESULT_BUILD);
+        const auto relevances = document_to_relevance.BuildOrdinaryMap();
+        METRICS_COUNT(DOCUMENTS_SCORED, relevances.size());
+        pmr::vector<Document> matched_documents(QueryArena::GetResource());
+        matched_documents.reserve(relevances.size());
+        for (const auto [document_id, relevance] : relevances)
+        {
+            const auto location = *FindDocument(index, document_id);
             matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+                {document_id, relevance, location.entry->segment->GetDocumentData(location.index).rating});
         }
         return matched_documents;
     }
@@ -186,88 +515,320 @@ template <typename ExecutionPolicy, typename DocumentPredicate>
 
 template <typename ExecutionPolicy>
 MatchReturn SearchServer::MatchDocument(ExecutionPolicy &policy, string_view raw_query, int document_id) const {
-    if (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>) {
+    // matching one document never pays for the parallel setup
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>
+                  || is_same_v<decay_t<ExecutionPolicy>, AutoExecutionPolicy>) {
         return MatchDocument(raw_query, document_id);
     } else {
-        if (!IsIdCorrect(document_id)) {
+        QueryArena::Scope arena_scope;
+        const auto index = AcquireIndex();
+        const auto location = FindDocument(*index, document_id);
+        if (!location) {
         throw out_of_range("неверный id"s);
         } 
         if (!IsValidWord(raw_query)) {
             throw invalid_argument("некорректный запрос"s);
         }
         auto query = ParseQuery(raw_query, true);
+        ExpandPrefixes(*index, query);
 
         vector<string_view> matched_words;
         matched_words.reserve(query.plus_words.size());
 
+        const Segment& segment = *location->entry->segment;
+        const auto& word_freqs = segment.GetWordFrequencies(location->index);
         auto is_word_present = [&](string_view word) {
-            return freqs_in_docs_.at(document_id).count(word) > 0;
+            return word_freqs.count(word) > 0;
         };
 
         if (any_of(query.minus_words.begin(), query.minus_words.end(), is_word_present)) {
-            return { matched_words, documents_.at(document_id).status };
+            matched_words.clear();
+            return { matched_words, segment.GetDocumentData(location->index).status };
         }
 
-        auto new_end = copy_if(query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), is_word_present);
-        matched_words.erase(new_end, matched_words.end());
+        // the key of the document, not the query text, so every matched word lives as long as the document
+        for (const string_view word : query.plus_words) {
+            const auto it = word_freqs.find(word);
+            if (it != word_freqs.end()) {
+                matched_words.push_back(it->first);
+            }
+        }
 
         sort(matched_words.begin(), matched_words.end());
         auto last = unique(matched_words.begin(), matched_words.end());
         matched_words.erase(last, matched_words.end());
 
-        return { matched_words, documents_.at(document_id).status };
+        return { matched_words, segment.GetDocumentData(location->index).status };
         }
 }
 
     
 template <typename DocumentPredicate>
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query, false);
+    return RankDocuments(raw_query, document_predicate, {}).documents;
+}
 
-    auto matched_documents = FindAllDocuments(query, document_predicate);
+template <typename DocumentPredicate>
+TopDocumentsResult SearchServer::FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate, const QueryBudget& budget) const {
+    return RankDocuments(raw_query, document_predicate, {nullptr, &budget});
+}
 
-    sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (abs(lhs.relevance - rhs.relevance) < EPSILON) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate, size_t offset, size_t limit) const {
+    return FindRankWindow(raw_query, document_predicate, nullptr, offset, limit);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate, const Document& after, size_t limit) const {
+    return FindRankWindow(raw_query, document_predicate, &after, 0, limit);
+}
+
+template <typename DocumentPredicate>
+auto SearchServer::PaginateTopDocuments(string raw_query, DocumentPredicate document_predicate, size_t page_size) const {
+    return PaginateLazily<Document>([this, raw_query = move(raw_query), document_predicate](const Document* after, size_t limit) {
+        return after ? FindTopDocuments(raw_query, document_predicate, *after, limit)
+                     : FindTopDocuments(raw_query, document_predicate, 0, limit);
+        }, page_size);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindRankWindow(string_view raw_query, DocumentPredicate document_predicate,
+                                              const Document* after, size_t offset, size_t limit) const {
+    QueryArena::Scope arena_scope;
+    METRICS_COUNT(QUERIES, 1);
+    const auto index = AcquireIndex();
+    const auto query = ParseMeasuredQuery(*index, raw_query);
+
+    auto matched_documents = FindAllDocuments(*index, query, document_predicate);
+
+    METRICS_PHASE(TOP_K);
+    if (after) {
+        matched_documents.erase(remove_if(matched_documents.begin(), matched_documents.end(), [after](const Document& document) {
+            return !IsMoreRelevant(*after, document);
+            }), matched_documents.end());
     }
-    return matched_documents;
+    if (offset >= matched_documents.size()) {
+        return {};
+    }
+    // two selections cut the window out in linear time, only the window itself is sorted
+    const auto first = matched_documents.begin() + offset;
+    const auto last = first + min(limit, matched_documents.size() - offset);
+    nth_element(matched_documents.begin(), last, matched_documents.end(), IsMoreRelevant);
+    nth_element(matched_documents.begin(), first, last, IsMoreRelevant);
+    sort(first, last, IsMoreRelevant);
+    return {first, last};
+}
+
+template <typename Executor, typename DocumentPredicate>
+future<TopDocumentsResult> SearchServer::FindTopDocumentsAsync(Executor& executor, string raw_query, DocumentPredicate document_predicate, QueryBudget budget) const {
+    auto task = make_shared<packaged_task<TopDocumentsResult()>>(
+        [this, raw_query = move(raw_query), document_predicate, budget = move(budget)] {
+            return FindTopDocuments(raw_query, document_predicate, budget);
+        });
+    auto result = task->get_future();
+    executor(function<void()>([task] {
+        (*task)();
+    }));
+    return result;
+}
+
+template <typename Executor>
+future<TopDocumentsResult> SearchServer::FindTopDocumentsAsync(Executor& executor, string raw_query, DocumentStatus status, QueryBudget budget) const {
+    return FindTopDocumentsAsync(executor, move(raw_query), [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+        }, move(budget));
+}
+
+template <typename DocumentPredicate>
+TopDocumentsResult SearchServer::RankDocuments(string_view raw_query, DocumentPredicate document_predicate, const RankOptions& options) const {
+    QueryArena::Scope arena_scope;
+    METRICS_COUNT(QUERIES, 1);
+    const auto index = AcquireIndex();
+    const auto query = ParseMeasuredQuery(*index, raw_query, options.statistics);
+
+    bool truncated = false;
+    auto matched_documents = FindAllDocuments(*index, query, document_predicate, options, &truncated);
+
+    METRICS_PHASE(TOP_K);
+    sort(matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+    const size_t count = min(matched_documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    return {vector<Document>(matched_documents.begin(), matched_documents.begin() + count), truncated};
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
 vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &policy, string_view raw_query, DocumentPredicate document_predicate) const {
-    if (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>) {
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>) {
         return FindTopDocuments(raw_query, document_predicate);
+    } else if constexpr (is_same_v<decay_t<ExecutionPolicy>, AutoExecutionPolicy>) {
+        return FindTopDocumentsAuto(raw_query, document_predicate, nullopt);
     } else {
-        const auto query = ParseQuery(raw_query, false);
+        QueryArena::Scope arena_scope;
+        METRICS_COUNT(QUERIES, 1);
+        const auto index = AcquireIndex();
+        const auto query = ParseMeasuredQuery(*index, raw_query);
 
-        auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+        auto matched_documents = FindAllDocuments(policy, *index, query, document_predicate);
 
-        sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
+        METRICS_PHASE(TOP_K);
+        sort(policy, matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+            const size_t count = min(matched_documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+            return vector<Document>(matched_documents.begin(), matched_documents.begin() + count);
+        }
+    }
+
+template <typename ExecutionPolicy>
+vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &policy, string_view raw_query, DocumentStatus status) const {
+    const auto document_predicate = [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;};
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>, AutoExecutionPolicy>) {
+        return FindTopDocumentsAuto(raw_query, document_predicate, status);
+    } else {
+        return FindTopDocuments(policy, raw_query, document_predicate);
+    }
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocumentsAuto(string_view raw_query, DocumentPredicate document_predicate, optional<DocumentStatus> status) const {
+    QueryArena::Scope arena_scope;
+    METRICS_COUNT(QUERIES, 1);
+    const auto index = AcquireIndex();
+    const auto query = ParseMeasuredQuery(*index, raw_query);
+
+    const QueryPlan plan = PlanQuery(*index, query);
+    pmr::vector<Document> matched_documents(QueryArena::GetResource());
+    if (plan == QueryPlan::PRUNED) {
+        matched_documents = FindPrunedDocuments(*index, query, document_predicate, status);
+    } else if (plan == QueryPlan::PARALLEL) {
+        matched_documents = FindAllDocuments(execution::par, *index, query, document_predicate);
+    } else {
+        matched_documents = FindAllDocuments(*index, query, document_predicate);
+    }
+
+    METRICS_PHASE(TOP_K);
+    if (plan == QueryPlan::PARALLEL) {
+        sort(execution::par, matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+    } else {
+        sort(matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+    }
+    const size_t count = min(matched_documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    return vector<Document>(matched_documents.begin(), matched_documents.begin() + count);
+}
+
+template <typename DocumentPredicate>
+pmr::vector<Document> SearchServer::FindPrunedDocuments(const Index& index, const Query& query, DocumentPredicate document_predicate,
+                                                        optional<DocumentStatus> status) const {
+    METRICS_COUNT(PRUNED_QUERIES, 1);
+    METRICS_PHASE(POSTING_TRAVERSAL);
+    pmr::memory_resource* resource = QueryArena::GetResource();
+
+    pmr::vector<double> inverse_document_freqs(resource);
+    for (const string_view word : query.plus_words) {
+        const size_t document_freq = ComputeDocumentFreq(index, word);
+        inverse_document_freqs.push_back(document_freq == 0 ? 0.0 : ComputeWordInverseDocumentFreq(index, document_freq));
+    }
+
+    pmr::vector<Document> matched_documents(resource);
+    pmr::unordered_set<int> seen(resource);
+    // the MAX_RESULT_DOCUMENT_COUNT best relevances so far, smallest on top
+    pmr::vector<double> top_relevances(resource);
+
+    // random access: the document is scored in full from its word frequencies
+    auto score = [&](const SegmentEntry& entry, uint32_t document_index) {
+        if (entry.IsDeleted(document_index)) {
+            return;
+        }
+        const int document_id = entry.segment->GetDocumentId(document_index);
+        if (!seen.insert(document_id).second) {
+            return;
+        }
+        const auto& document_data = entry.segment->GetDocumentData(document_index);
+        if (!MeasuredPredicate(document_predicate, document_id, document_data)) {
+            return;
+        }
+        const auto& word_freqs = entry.segment->GetWordFrequencies(document_index);
+        for (const string_view word : query.minus_words) {
+            if (word_freqs.count(word) > 0) {
+                return;
             }
-            else {
-                return lhs.relevance > rhs.relevance;
+        }
+        // summed in the order of FindAllDocuments, so relevances are bit for bit the same
+        double relevance = 0.0;
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            if (const auto it = word_freqs.find(query.plus_words[i]); it != word_freqs.end()) {
+                relevance += it->second * inverse_document_freqs[i];
             }
-                });
-            if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-                matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
+        matched_documents.push_back({document_id, relevance, document_data.rating});
+        top_relevances.push_back(relevance);
+        push_heap(top_relevances.begin(), top_relevances.end(), greater<>());
+        if (top_relevances.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            pop_heap(top_relevances.begin(), top_relevances.end(), greater<>());
+            top_relevances.pop_back();
+        }
+    };
+
+    // sorted access: one cursor per impact-ordered list, other lists are short and read in full
+    struct Cursor {
+        const SegmentEntry* entry;
+        size_t word;
+        size_t position;
+        Segment::Postings postings;
+    };
+    pmr::vector<Cursor> cursors(resource);
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const string_view word = query.plus_words[i];
+        for (const SegmentEntry& entry : index.segments_) {
+            if (!entry.segment->HasImpactPostings(word)) {
+                const auto postings = entry.segment->GetPostings(word);
+                METRICS_COUNT(POSTINGS_SCANNED, postings.size());
+                for (const Posting& posting : postings) {
+                    score(entry, posting.document_index);
+                }
+                continue;
+            }
+            for (size_t group = 0; group < DOCUMENT_STATUS_COUNT; ++group) {
+                if (status && static_cast<size_t>(*status) != group) {
+                    continue;
+                }
+                const auto postings = entry.segment->GetImpactPostings(word, static_cast<DocumentStatus>(group));
+                if (postings.size() > 0) {
+                    cursors.push_back({&entry, i, 0, postings});
+                }
             }
-            return matched_documents;
         }
     }
 
-template <typename ExecutionPolicy>
-vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &policy, string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;});
+    pmr::vector<double> word_bounds(query.plus_words.size(), 0.0, resource);
+    while (true) {
+        // an unseen document has at most the current term frequency of every word it contains
+        fill(word_bounds.begin(), word_bounds.end(), 0.0);
+        Cursor* next = nullptr;
+        double next_impact = 0.0;
+        for (Cursor& cursor : cursors) {
+            if (cursor.position == cursor.postings.size()) {
+                continue;
+            }
+            const double impact = cursor.postings.begin()[cursor.position].term_freq * inverse_document_freqs[cursor.word];
+            word_bounds[cursor.word] = max(word_bounds[cursor.word], impact);
+            if (!next || impact > next_impact) {
+                next = &cursor;
+                next_impact = impact;
+            }
+        }
+        if (!next) {
+            break;
+        }
+        const double bound = accumulate(word_bounds.begin(), word_bounds.end(), 0.0);
+        // documents within EPSILON of the last top one are ranked by rating, so they must be seen too
+        if (top_relevances.size() == MAX_RESULT_DOCUMENT_COUNT && top_relevances.front() - EPSILON > bound) {
+            break;
+        }
+        METRICS_COUNT(POSTINGS_SCANNED, 1);
+        score(*next->entry, next->postings.begin()[next->position].document_index);
+        ++next->position;
+    }
+    METRICS_COUNT(DOCUMENTS_SCORED, matched_documents.size());
+    return matched_documents;
 }
 
 template <typename ExecutionPolicy>
@@ -0,0 +1,365 @@
+#include "segment.h"
+#include <algorithm>
+#include <limits>
+
+Segment::Segment(MemoryAccounting& memory)
+    : document_ids_(CountingAllocator<int>(memory.GetCounter(MemoryCategory::DOCUMENTS)))
+    , documents_(CountingAllocator<DocumentData>(memory.GetCounter(MemoryCategory::DOCUMENTS)))
+    , word_freqs_(CountingAllocator<shared_ptr<const WordFrequencies>>(memory.GetCounter(MemoryCategory::WORD_FREQUENCIES)))
+    , words_(CountingAllocator<string_view>(memory.GetCounter(MemoryCategory::POSTINGS)))
+    , word_offsets_(1, 0, CountingAllocator<uint32_t>(memory.GetCounter(MemoryCategory::POSTINGS)))
+    , postings_(CountingAllocator<Posting>(memory.GetCounter(MemoryCategory::POSTINGS)))
+    , impact_lists_(CountingAllocator<ImpactList>(memory.GetCounter(MemoryCategory::POSTINGS)))
+    , impact_postings_(CountingAllocator<Posting>(memory.GetCounter(MemoryCategory::POSTINGS)))
+{
+}
+
+Segment::Segment(shared_ptr<const Buffer> buffer)
+    : Segment(buffer->memory_)
+{
+    buffer_document_count_ = buffer->GetDocumentCount();
+    buffer_ = move(buffer);
+}
+
+Segment Segment::Merge(MemoryAccounting& memory, const vector<Part>& buffer_parts) {
+    // views of the write buffer are unpacked first; reserved, so the parts can point into it
+    vector<Segment> unpacked;
+    unpacked.reserve(buffer_parts.size());
+    vector<Part> parts = buffer_parts;
+    for (Part& part : parts) {
+        if (part.segment->buffer_) {
+            unpacked.push_back(part.segment->buffer_->Unpack(part.segment->buffer_document_count_));
+            part.segment = &unpacked.back();
+        }
+    }
+
+    struct Source {
+        int id;
+        size_t part;
+        uint32_t index;
+    };
+    vector<Source> sources;
+    for (size_t part = 0; part < parts.size(); ++part) {
+        const Segment& segment = *parts[part].segment;
+        for (uint32_t i = 0; i < segment.document_ids_.size(); ++i) {
+            if (!parts[part].deleted || !parts[part].deleted->Test(i)) {
+                sources.push_back({segment.document_ids_[i], part, i});
+            }
+        }
+    }
+    sort(sources.begin(), sources.end(), [](const Source& lhs, const Source& rhs) {
+        return lhs.id < rhs.id;
+    });
+
+    const uint32_t dropped = numeric_limits<uint32_t>::max();
+    vector<vector<uint32_t>> new_indexes(parts.size());
+    for (size_t part = 0; part < parts.size(); ++part) {
+        new_indexes[part].assign(parts[part].segment->document_ids_.size(), dropped);
+    }
+    Segment result(memory);
+    result.document_ids_.reserve(sources.size());
+    result.documents_.reserve(sources.size());
+    result.word_freqs_.reserve(sources.size());
+    for (const auto& [id, part, index] : sources) {
+        const Segment& segment = *parts[part].segment;
+        new_indexes[part][index] = result.document_ids_.size();
+        result.document_ids_.push_back(id);
+        result.documents_.push_back(segment.documents_[index]);
+        result.word_freqs_.push_back(segment.word_freqs_[index]);
+    }
+
+    vector<string_view> words;
+    for (const Part& part : parts) {
+        words.insert(words.end(), part.segment->words_.begin(), part.segment->words_.end());
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+
+    // every part lists its words in the same order, so one cursor per part is enough
+    vector<size_t> cursors(parts.size(), 0);
+    for (const string_view word : words) {
+        const size_t first = result.postings_.size();
+        size_t sources_with_word = 0;
+        for (size_t part = 0; part < parts.size(); ++part) {
+            const Segment& segment = *parts[part].segment;
+            size_t& cursor = cursors[part];
+            if (cursor == segment.words_.size() || segment.words_[cursor] != word) {
+                continue;
+            }
+            ++sources_with_word;
+            for (uint32_t i = segment.word_offsets_[cursor]; i < segment.word_offsets_[cursor + 1]; ++i) {
+                const Posting& posting = segment.postings_[i];
+                const uint32_t new_index = new_indexes[part][posting.document_index];
+                if (new_index != dropped) {
+                    result.postings_.push_back({new_index, posting.term_freq});
+                }
+            }
+            ++cursor;
+        }
+        if (result.postings_.size() == first) {
+            continue;
+        }
+        // an unpacked buffer lists its documents in the order they were added, not by id
+        if (sources_with_word > 1 || !is_sorted(result.postings_.begin() + first, result.postings_.end(),
+                                                [](const Posting& lhs, const Posting& rhs) {
+                                                    return lhs.document_index < rhs.document_index;
+                                                })) {
+            sort(result.postings_.begin() + first, result.postings_.end(), [](const Posting& lhs, const Posting& rhs) {
+                return lhs.document_index < rhs.document_index;
+            });
+        }
+        // the word may point into the text of a dropped document, so take it from a document that stays
+        const WordFrequencies& word_freqs = *result.word_freqs_[result.postings_[first].document_index];
+        result.words_.push_back(word_freqs.find(word)->first);
+        result.word_offsets_.push_back(result.postings_.size());
+    }
+    result.BuildImpactPostings();
+    return result;
+}
+
+size_t Segment::GetDocumentCount() const {
+    return buffer_ ? buffer_document_count_ : document_ids_.size();
+}
+
+size_t Segment::GetPostingCount() const {
+    return buffer_ ? buffer_->GetPostingCount() : postings_.size();
+}
+
+int Segment::GetDocumentId(uint32_t index) const {
+    return buffer_ ? buffer_->document_ids_[index] : document_ids_[index];
+}
+
+const DocumentData& Segment::GetDocumentData(uint32_t index) const {
+    return buffer_ ? buffer_->documents_[index] : documents_[index];
+}
+
+const Segment::WordFrequencies& Segment::GetWordFrequencies(uint32_t index) const {
+    return buffer_ ? *buffer_->word_freqs_[index] : *word_freqs_[index];
+}
+
+int Segment::FindDocument(int document_id) const {
+    if (buffer_) {
+        return buffer_->FindDocument(document_id, buffer_document_count_);
+    }
+    const auto it = lower_bound(document_ids_.begin(), document_ids_.end(), document_id);
+    if (it == document_ids_.end() || *it != document_id) {
+        return -1;
+    }
+    return it - document_ids_.begin();
+}
+
+Segment::Postings Segment::GetPostings(string_view word) const {
+    if (buffer_) {
+        return buffer_->GetPostings(word, buffer_document_count_);
+    }
+    const auto it = lower_bound(words_.begin(), words_.end(), word);
+    if (it == words_.end() || *it != word) {
+        return {nullptr, nullptr};
+    }
+    const size_t i = it - words_.begin();
+    return {postings_.data() + word_offsets_[i], postings_.data() + word_offsets_[i + 1]};
+}
+
+void Segment::AppendWordsWithPrefix(string_view prefix, pmr::vector<string_view>& words) const {
+    if (buffer_) {
+        buffer_->AppendWordsWithPrefix(prefix, buffer_document_count_, words);
+        return;
+    }
+    const auto first = lower_bound(words_.begin(), words_.end(), prefix);
+    const auto last = partition_point(first, words_.end(), [prefix](string_view word) {
+        return word.substr(0, prefix.size()) == prefix;
+    });
+    words.insert(words.end(), first, last);
+}
+
+bool Segment::HasImpactPostings(string_view word) const {
+    return FindImpactList(word) != nullptr;
+}
+
+Segment::Postings Segment::GetImpactPostings(string_view word, DocumentStatus status) const {
+    const ImpactList* list = FindImpactList(word);
+    if (!list) {
+        return {nullptr, nullptr};
+    }
+    const size_t group = static_cast<size_t>(status);
+    return {impact_postings_.data() + list->offsets[group], impact_postings_.data() + list->offsets[group + 1]};
+}
+
+void Segment::BuildImpactPostings() {
+    for (uint32_t i = 0; i + 1 < word_offsets_.size(); ++i) {
+        const auto first = postings_.begin() + word_offsets_[i];
+        const auto last = postings_.begin() + word_offsets_[i + 1];
+        if (static_cast<size_t>(last - first) < IMPACT_POSTINGS_MIN_LENGTH) {
+            continue;
+        }
+        ImpactList list{i, {}};
+        const size_t begin = impact_postings_.size();
+        impact_postings_.insert(impact_postings_.end(), first, last);
+        sort(impact_postings_.begin() + begin, impact_postings_.end(), [this](const Posting& lhs, const Posting& rhs) {
+            const DocumentStatus lhs_status = documents_[lhs.document_index].status;
+            const DocumentStatus rhs_status = documents_[rhs.document_index].status;
+            if (lhs_status != rhs_status) {
+                return lhs_status < rhs_status;
+            }
+            if (lhs.term_freq != rhs.term_freq) {
+                return lhs.term_freq > rhs.term_freq;
+            }
+            return lhs.document_index < rhs.document_index;
+        });
+        size_t position = begin;
+        for (size_t status = 0; status <= DOCUMENT_STATUS_COUNT; ++status) {
+            while (position < impact_postings_.size()
+                   && static_cast<size_t>(documents_[impact_postings_[position].document_index].status) < status) {
+                ++position;
+            }
+            list.offsets[status] = position;
+        }
+        impact_lists_.push_back(list);
+    }
+}
+
+const Segment::ImpactList* Segment::FindImpactList(string_view word) const {
+    if (impact_lists_.empty()) {
+        return nullptr;
+    }
+    const auto word_it = lower_bound(words_.begin(), words_.end(), word);
+    if (word_it == words_.end() || *word_it != word) {
+        return nullptr;
+    }
+    const uint32_t word_index = word_it - words_.begin();
+    const auto it = lower_bound(impact_lists_.begin(), impact_lists_.end(), word_index, [](const ImpactList& list, uint32_t index) {
+        return list.word_index < index;
+    });
+    if (it == impact_lists_.end() || it->word_index != word_index) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+Segment::Buffer::Buffer(MemoryAccounting& memory, size_t capacity)
+    : memory_(memory)
+    , document_ids_(capacity, 0, CountingAllocator<int>(memory.GetCounter(MemoryCategory::DOCUMENTS)))
+    , documents_(capacity, DocumentData{}, CountingAllocator<DocumentData>(memory.GetCounter(MemoryCategory::DOCUMENTS)))
+    , word_freqs_(capacity, nullptr,
+                  CountingAllocator<shared_ptr<const WordFrequencies>>(memory.GetCounter(MemoryCategory::WORD_FREQUENCIES)))
+    , postings_(CountingAllocator<pair<const string_view, PostingList>>(memory.GetCounter(MemoryCategory::POSTINGS)))
+    , retired_postings_(CountingAllocator<PostingList>(memory.GetCounter(MemoryCategory::POSTINGS)))
+{
+}
+
+void Segment::Buffer::AddDocument(int document_id, DocumentData data, shared_ptr<const WordFrequencies> word_freqs) {
+    const uint32_t index = document_count_;
+    document_ids_[index] = document_id;
+    documents_[index] = data;
+    {
+        unique_lock lock(mutex_);
+        for (const auto& [word, term_freq] : *word_freqs) {
+            auto it = postings_.find(word);
+            if (it == postings_.end()) {
+                it = postings_.emplace(word, PostingList(CountingAllocator<Posting>(memory_.GetCounter(MemoryCategory::POSTINGS)))).first;
+            }
+            PostingList& postings = it->second;
+            if (postings.size() == postings.capacity() && !postings.empty()) {
+                PostingList grown(postings.get_allocator());
+                grown.reserve(postings.size() * 2);
+                grown.assign(postings.begin(), postings.end());
+                retired_postings_.push_back(move(postings));
+                postings = move(grown);
+            }
+            postings.push_back({index, term_freq});
+        }
+    }
+    posting_count_ += word_freqs->size();
+    word_freqs_[index] = move(word_freqs);
+    ++document_count_;
+}
+
+size_t Segment::Buffer::GetDocumentCount() const {
+    return document_count_;
+}
+
+size_t Segment::Buffer::GetCapacity() const {
+    return document_ids_.size();
+}
+
+size_t Segment::Buffer::GetPostingCount() const {
+    return posting_count_;
+}
+
+int Segment::Buffer::FindDocument(int document_id, size_t document_count) const {
+    const auto last = document_ids_.begin() + document_count;
+    const auto it = find(document_ids_.begin(), last, document_id);
+    return it == last ? -1 : it - document_ids_.begin();
+}
+
+Segment::Postings Segment::Buffer::GetPostings(string_view word, size_t document_count) const {
+    const Posting* first = nullptr;
+    size_t size = 0;
+    {
+        shared_lock lock(mutex_);
+        const auto it = postings_.find(word);
+        if (it == postings_.end()) {
+            return {nullptr, nullptr};
+        }
+        first = it->second.data();
+        size = it->second.size();
+    }
+    while (size > 0 && first[size - 1].document_index >= document_count) {
+        --size;
+    }
+    return {first, first + size};
+}
+
+void Segment::Buffer::AppendWordsWithPrefix(string_view prefix, size_t document_count, pmr::vector<string_view>& words) const {
+    shared_lock lock(mutex_);
+    for (auto it = postings_.lower_bound(prefix); it != postings_.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+        if (it->second.front().document_index < document_count) {
+            words.push_back(it->first);
+        }
+    }
+}
+
+Segment Segment::Buffer::Unpack(size_t document_count) const {
+    Segment result(memory_);
+    result.document_ids_.assign(document_ids_.begin(), document_ids_.begin() + document_count);
+    result.documents_.assign(documents_.begin(), documents_.begin() + document_count);
+    result.word_freqs_.assign(word_freqs_.begin(), word_freqs_.begin() + document_count);
+    shared_lock lock(mutex_);
+    for (const auto& [word, postings] : postings_) {
+        const auto last = partition_point(postings.begin(), postings.end(), [document_count](const Posting& posting) {
+            return posting.document_index < document_count;
+        });
+        if (last == postings.begin()) {
+            continue;
+        }
+        result.words_.push_back(word);
+        result.postings_.insert(result.postings_.end(), postings.begin(), last);
+        result.word_offsets_.push_back(result.postings_.size());
+    }
+    return result;
+}
+
+Segment::Tombstones::Tombstones(MemoryAccounting& memory)
+    : counter_(memory.GetCounter(MemoryCategory::DOCUMENTS))
+    , chunks_(CountingAllocator<shared_ptr<const Chunk>>(counter_))
+{
+}
+
+bool Segment::Tombstones::Test(uint32_t index) const {
+    const size_t chunk = index / TOMBSTONE_CHUNK_SIZE;
+    const size_t bit = index % TOMBSTONE_CHUNK_SIZE;
+    return chunk < chunks_.size() && chunks_[chunk] && ((*chunks_[chunk])[bit / 64] >> (bit % 64) & 1) != 0;
+}
+
+void Segment::Tombstones::Set(uint32_t index) {
+    const size_t chunk = index / TOMBSTONE_CHUNK_SIZE;
+    const size_t bit = index % TOMBSTONE_CHUNK_SIZE;
+    if (chunk >= chunks_.size()) {
+        chunks_.resize(chunk + 1);
+    }
+    auto copy = chunks_[chunk]
+        ? allocate_shared<Chunk>(CountingAllocator<Chunk>(counter_), *chunks_[chunk])
+        : allocate_shared<Chunk>(CountingAllocator<Chunk>(counter_));
+    (*copy)[bit / 64] |= uint64_t{1} << (bit % 64);
+    chunks_[chunk] = move(copy);
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include "document.h"
+#include "memory_accounting.h"
+#include "paginator.h"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+struct Posting {
+    uint32_t document_index;
+    double term_freq;
+};
+
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
+// words with at least this many postings in a sealed segment also get impact-ordered postings
+const size_t IMPACT_POSTINGS_MIN_LENGTH = 128;
+
+// removal marks are copied on write in chunks of this many documents
+const size_t TOMBSTONE_CHUNK_SIZE = 4096;
+
+// An immutable part of the index. Documents are stored sorted by id, posting lists
+// refer to them by position and lie back to back in one array in word order.
+// A segment may instead be a view of the first documents of the write buffer.
+class Segment {
+public:
+    class Buffer;
+    class Tombstones;
+
+    using WordFrequencies = map<string_view, double, less<string_view>,
+                                CountingAllocator<pair<const string_view, double>>>;
+    using Postings = IteratorRange<const Posting*>;
+
+    struct Part {
+        const Segment* segment;
+        // documents marked here are left out of the merge; may be null
+        const Tombstones* deleted;
+    };
+
+    explicit Segment(MemoryAccounting& memory);
+
+    // sees the documents added to the buffer before the call and nothing added later
+    explicit Segment(shared_ptr<const Buffer> buffer);
+
+    // parts may be write buffer views, the result is always in the compact layout
+    static Segment Merge(MemoryAccounting& memory, const vector<Part>& parts);
+
+    size_t GetDocumentCount() const;
+
+    size_t GetPostingCount() const;
+
+    int GetDocumentId(uint32_t index) const;
+
+    const DocumentData& GetDocumentData(uint32_t index) const;
+
+    const WordFrequencies& GetWordFrequencies(uint32_t index) const;
+
+    // position of the document or -1
+    int FindDocument(int document_id) const;
+
+    Postings GetPostings(string_view word) const;
+
+    // appends the words starting with prefix in sorted order, found with two binary searches
+    void AppendWordsWithPrefix(string_view prefix, pmr::vector<string_view>& words) const;
+
+    bool HasImpactPostings(string_view word) const;
+
+    // Postings of a long word in documents with the given status, by term frequency descending,
+    // so the head of the range is the top of the word for that status. Empty for other words.
+    Postings GetImpactPostings(string_view word, DocumentStatus status) const;
+
+private:
+    shared_ptr<const Buffer> buffer_;
+    size_t buffer_document_count_ = 0;
+
+    CountedVector<int> document_ids_;
+    CountedVector<DocumentData> documents_;
+    CountedVector<shared_ptr<const WordFrequencies>> word_freqs_;
+    CountedVector<string_view> words_;
+    // postings of words_[i] are postings_[word_offsets_[i] .. word_offsets_[i + 1])
+    CountedVector<uint32_t> word_offsets_;
+    CountedVector<Posting> postings_;
+
+    struct ImpactList {
+        uint32_t word_index;
+        // postings of status s are impact_postings_[offsets[s] .. offsets[s + 1])
+        array<uint32_t, DOCUMENT_STATUS_COUNT + 1> offsets;
+    };
+
+    // sorted by word_index
+    CountedVector<ImpactList> impact_lists_;
+    CountedVector<Posting> impact_postings_;
+
+    void BuildImpactPostings();
+
+    const ImpactList* FindImpactList(string_view word) const;
+};
+
+// The write buffer. Documents and postings are only appended, so a Segment view stays valid
+// while later documents are added: it looks at its first documents only. Readers take a
+// shared lock just to find a posting list; the list may have grown since the view was made,
+// and postings of later documents are cut off its end.
+class Segment::Buffer {
+public:
+    Buffer(MemoryAccounting& memory, size_t capacity);
+
+    // called by one writer at a time, at most capacity times
+    void AddDocument(int document_id, DocumentData data, shared_ptr<const WordFrequencies> word_freqs);
+
+    size_t GetDocumentCount() const;
+
+    size_t GetCapacity() const;
+
+    size_t GetPostingCount() const;
+
+private:
+    friend class Segment;
+
+    // a list that runs out of capacity moves to a new array, the old one is kept for readers
+    using PostingList = CountedVector<Posting>;
+
+    MemoryAccounting& memory_;
+    // allocated in full up front and written in place, so readers never see them move
+    CountedVector<int> document_ids_;
+    CountedVector<DocumentData> documents_;
+    CountedVector<shared_ptr<const WordFrequencies>> word_freqs_;
+    size_t document_count_ = 0;
+    atomic<size_t> posting_count_{0};
+
+    mutable shared_mutex mutex_;
+    map<string_view, PostingList, less<>, CountingAllocator<pair<const string_view, PostingList>>> postings_;
+    CountedVector<PostingList> retired_postings_;
+
+    int FindDocument(int document_id, size_t document_count) const;
+
+    Postings GetPostings(string_view word, size_t document_count) const;
+
+    void AppendWordsWithPrefix(string_view prefix, size_t document_count, pmr::vector<string_view>& words) const;
+
+    // the first document_count documents in the compact layout, but in the order they were added
+    Segment Unpack(size_t document_count) const;
+};
+
+// Marks of removed documents. Copies share their chunks and Set copies only the chunk it
+// changes, so removing a document from a large segment does not copy all of its marks.
+class Segment::Tombstones {
+public:
+    explicit Tombstones(MemoryAccounting& memory);
+
+    // documents past the last chunk, e.g. ones added to the write buffer later, are not removed
+    bool Test(uint32_t index) const;
+
+    void Set(uint32_t index);
+
+private:
+    using Chunk = array<uint64_t, TOMBSTONE_CHUNK_SIZE / 64>;
+
+    atomic<int64_t>* counter_;
+    CountedVector<shared_ptr<const Chunk>> chunks_;
+};
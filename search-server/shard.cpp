@@ -0,0 +1,142 @@
+#include "shard.h"
+#include "shard_protocol.h"
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+LocalShard::LocalShard(const string& stop_words_text)
+    : server_(stop_words_text)
+{
+}
+
+void LocalShard::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    server_.AddDocument(document_id, document, status, ratings);
+}
+
+void LocalShard::RemoveDocument(int document_id) {
+    server_.RemoveDocument(document_id);
+}
+
+int LocalShard::GetDocumentCount() const {
+    return server_.GetDocumentCount();
+}
+
+TermStatistics LocalShard::GetTermStatistics(string_view raw_query) const {
+    return server_.GetTermStatistics(raw_query);
+}
+
+vector<Document> LocalShard::FindTopDocuments(string_view raw_query, DocumentStatus status, const TermStatistics& statistics) const {
+    return server_.FindTopDocuments(raw_query, status, statistics);
+}
+
+ShardMatchReturn LocalShard::MatchDocument(string_view raw_query, int document_id) const {
+    const auto [words, status] = server_.MatchDocument(raw_query, document_id);
+    return { vector<string>(words.begin(), words.end()), status };
+}
+
+ProcessShard::ProcessShard(const string& executable, const string& stop_words_text) {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+        throw runtime_error("Cannot create shard socket"s);
+    }
+    pid_ = fork();
+    if (pid_ < 0) {
+        close(sockets[0]);
+        close(sockets[1]);
+        throw runtime_error("Cannot start shard process"s);
+    }
+    if (pid_ == 0) {
+        close(sockets[0]);
+        dup2(sockets[1], STDIN_FILENO);
+        dup2(sockets[1], STDOUT_FILENO);
+        close(sockets[1]);
+        execl(executable.c_str(), executable.c_str(), stop_words_text.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(sockets[1]);
+    socket_ = sockets[0];
+}
+
+ProcessShard::~ProcessShard() {
+    // the shard exits when its input is closed; CLOEXEC keeps other shards from holding it open
+    close(socket_);
+    waitpid(pid_, nullptr, 0);
+}
+
+void ProcessShard::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    ostringstream request;
+    request << "ADD "s << document_id << ' ' << static_cast<int>(status) << ' ' << ratings.size();
+    for (const int rating : ratings) {
+        request << ' ' << rating;
+    }
+    request << ' ' << document;
+    Call(request.str());
+}
+
+void ProcessShard::RemoveDocument(int document_id) {
+    Call("REMOVE "s + to_string(document_id));
+}
+
+int ProcessShard::GetDocumentCount() const {
+    return stoi(Call("COUNT"s));
+}
+
+TermStatistics ProcessShard::GetTermStatistics(string_view raw_query) const {
+    istringstream response(Call("STATS "s + string(raw_query)));
+    return DecodeStatistics(response);
+}
+
+vector<Document> ProcessShard::FindTopDocuments(string_view raw_query, DocumentStatus status, const TermStatistics& statistics) const {
+    istringstream response(Call("FIND "s + to_string(static_cast<int>(status)) + ' ' + EncodeStatistics(statistics)
+                                + ' ' + string(raw_query)));
+    size_t count;
+    response >> count;
+    vector<Document> documents(count);
+    for (Document& document : documents) {
+        response >> document.id >> document.relevance >> document.rating;
+    }
+    return documents;
+}
+
+ShardMatchReturn ProcessShard::MatchDocument(string_view raw_query, int document_id) const {
+    istringstream response(Call("MATCH "s + to_string(document_id) + ' ' + string(raw_query)));
+    int status;
+    size_t count;
+    response >> status >> count;
+    vector<string> matched_words(count);
+    for (string& word : matched_words) {
+        response >> word;
+    }
+    return { matched_words, static_cast<DocumentStatus>(status) };
+}
+
+string ProcessShard::Call(const string& request) const {
+    if (request.find('\n') != string::npos) {
+        throw invalid_argument("Shard request must not contain line breaks"s);
+    }
+    lock_guard guard(mutex_);
+    const string line = request + '\n';
+    for (size_t sent = 0; sent < line.size();) {
+        const ssize_t written = send(socket_, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0) {
+            throw runtime_error("Shard process is gone"s);
+        }
+        sent += written;
+    }
+    size_t end;
+    while ((end = received_.find('\n')) == string::npos) {
+        char buffer[4096];
+        const ssize_t read = recv(socket_, buffer, sizeof(buffer), 0);
+        if (read <= 0) {
+            throw runtime_error("Shard process is gone"s);
+        }
+        received_.append(buffer, read);
+    }
+    string response = received_.substr(0, end);
+    received_.erase(0, end + 1);
+    if (response.rfind("OK"s, 0) != 0) {
+        ThrowShardError(response);
+    }
+    return response.substr(2);
+}
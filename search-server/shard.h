@@ -0,0 +1,81 @@
+#pragma once
+#include "search_server.h"
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <sys/types.h>
+
+// matched words are copied, a shard may drop the document and its text right after answering
+using ShardMatchReturn = tuple<vector<string>, DocumentStatus>;
+
+// One partition of a ShardedSearchServer. Only status filters are supported,
+// because a predicate cannot be shipped to a shard in another process.
+class Shard {
+public:
+    virtual ~Shard() = default;
+
+    virtual void AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) = 0;
+
+    virtual void RemoveDocument(int document_id) = 0;
+
+    virtual int GetDocumentCount() const = 0;
+
+    virtual TermStatistics GetTermStatistics(string_view raw_query) const = 0;
+
+    virtual vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status, const TermStatistics& statistics) const = 0;
+
+    virtual ShardMatchReturn MatchDocument(string_view raw_query, int document_id) const = 0;
+};
+
+class LocalShard : public Shard {
+public:
+    explicit LocalShard(const string& stop_words_text);
+
+    void AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) override;
+
+    void RemoveDocument(int document_id) override;
+
+    int GetDocumentCount() const override;
+
+    TermStatistics GetTermStatistics(string_view raw_query) const override;
+
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status, const TermStatistics& statistics) const override;
+
+    ShardMatchReturn MatchDocument(string_view raw_query, int document_id) const override;
+
+private:
+    SearchServer server_;
+};
+
+// Runs the shard_server executable as a child process and talks to it over a local socket.
+class ProcessShard : public Shard {
+public:
+    ProcessShard(const string& executable, const string& stop_words_text);
+
+    ~ProcessShard() override;
+
+    ProcessShard(const ProcessShard&) = delete;
+    ProcessShard& operator=(const ProcessShard&) = delete;
+
+    void AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) override;
+
+    void RemoveDocument(int document_id) override;
+
+    int GetDocumentCount() const override;
+
+    TermStatistics GetTermStatistics(string_view raw_query) const override;
+
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status, const TermStatistics& statistics) const override;
+
+    ShardMatchReturn MatchDocument(string_view raw_query, int document_id) const override;
+
+private:
+    // sends one request line and returns the payload of the response line
+    string Call(const string& request) const;
+
+    mutable mutex mutex_;
+    mutable string received_;
+    pid_t pid_ = -1;
+    int socket_ = -1;
+};
@@ -0,0 +1,112 @@
+#include "shard_protocol.h"
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+string ReadText(istream& request) {
+    request.get();
+    string text;
+    getline(request, text);
+    return text;
+}
+
+string HandleRequest(SearchServer& search_server, const string& command, istream& request) {
+    ostringstream payload;
+    payload << setprecision(17);
+    if (command == "ADD"s) {
+        int document_id, status;
+        size_t rating_count;
+        request >> document_id >> status >> rating_count;
+        vector<int> ratings(rating_count);
+        for (int& rating : ratings) {
+            request >> rating;
+        }
+        search_server.AddDocument(document_id, ReadText(request), static_cast<DocumentStatus>(status), ratings);
+    } else if (command == "REMOVE"s) {
+        int document_id;
+        request >> document_id;
+        search_server.RemoveDocument(document_id);
+    } else if (command == "COUNT"s) {
+        payload << ' ' << search_server.GetDocumentCount();
+    } else if (command == "STATS"s) {
+        payload << ' ' << EncodeStatistics(search_server.GetTermStatistics(ReadText(request)));
+    } else if (command == "FIND"s) {
+        int status;
+        request >> status;
+        const TermStatistics statistics = DecodeStatistics(request);
+        const auto documents = search_server.FindTopDocuments(ReadText(request), static_cast<DocumentStatus>(status), statistics);
+        payload << ' ' << documents.size();
+        for (const Document& document : documents) {
+            payload << ' ' << document.id << ' ' << document.relevance << ' ' << document.rating;
+        }
+    } else if (command == "MATCH"s) {
+        int document_id;
+        request >> document_id;
+        const string query = ReadText(request);
+        const auto [words, status] = search_server.MatchDocument(query, document_id);
+        payload << ' ' << static_cast<int>(status) << ' ' << words.size();
+        for (const string_view word : words) {
+            payload << ' ' << word;
+        }
+    } else {
+        throw invalid_argument("Unknown shard command "s + command);
+    }
+    return payload.str();
+}
+
+}  // namespace
+
+void ServeShard(SearchServer& search_server, istream& input, ostream& output) {
+    for (string line; getline(input, line);) {
+        istringstream request(line);
+        string command;
+        request >> command;
+        try {
+            const string payload = HandleRequest(search_server, command, request);
+            output << "OK"s << payload << endl;
+        } catch (const invalid_argument& e) {
+            output << "ERROR invalid_argument "s << e.what() << endl;
+        } catch (const out_of_range& e) {
+            output << "ERROR out_of_range "s << e.what() << endl;
+        } catch (const exception& e) {
+            output << "ERROR runtime_error "s << e.what() << endl;
+        }
+    }
+}
+
+string EncodeStatistics(const TermStatistics& statistics) {
+    ostringstream out;
+    out << statistics.document_count << ' ' << statistics.document_freqs.size();
+    for (const auto& [word, document_freq] : statistics.document_freqs) {
+        out << ' ' << word << ' ' << document_freq;
+    }
+    return out.str();
+}
+
+TermStatistics DecodeStatistics(istream& input) {
+    TermStatistics statistics;
+    size_t word_count;
+    input >> statistics.document_count >> word_count;
+    for (size_t i = 0; i < word_count; ++i) {
+        string word;
+        size_t document_freq;
+        input >> word >> document_freq;
+        statistics.document_freqs.emplace(move(word), document_freq);
+    }
+    return statistics;
+}
+
+void ThrowShardError(const string& response) {
+    istringstream in(response);
+    string status, kind;
+    in >> status >> kind;
+    const string message = ReadText(in);
+    if (kind == "invalid_argument"s) {
+        throw invalid_argument(message);
+    }
+    if (kind == "out_of_range"s) {
+        throw out_of_range(message);
+    }
+    throw runtime_error(message);
+}
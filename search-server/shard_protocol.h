@@ -0,0 +1,25 @@
+#pragma once
+#include "search_server.h"
+#include <iostream>
+#include <string>
+
+// Line protocol between ProcessShard and shard_server. Documents and queries never contain
+// control characters, so every request and every response fits on one line. Free text
+// always goes last:
+//   ADD <id> <status> <rating count> <ratings...> <document>  ->  OK
+//   REMOVE <id>                                              ->  OK
+//   COUNT                                                    ->  OK <document count>
+//   STATS <query>                                            ->  OK <statistics>
+//   FIND <status> <statistics> <query>                       ->  OK <count> (<id> <relevance> <rating>)...
+//   MATCH <id> <query>                                       ->  OK <status> <count> <words...>
+// where <statistics> is <document count> <word count> (<word> <document freq>)...
+// A failed request is answered with ERROR <exception kind> <message>.
+
+void ServeShard(SearchServer& search_server, istream& input, ostream& output);
+
+string EncodeStatistics(const TermStatistics& statistics);
+
+TermStatistics DecodeStatistics(istream& input);
+
+// throws the exception described by an ERROR response
+[[noreturn]] void ThrowShardError(const string& response);
@@ -0,0 +1,13 @@
+#include "search_server.h"
+#include "shard_protocol.h"
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Serves one shard of a ShardedSearchServer over stdin/stdout, see shard_protocol.h.
+int main(int argc, char* argv[]) {
+    ios::sync_with_stdio(false);
+    SearchServer search_server(argc > 1 ? string(argv[1]) : ""s);
+    ServeShard(search_server, cin, cout);
+}
@@ -0,0 +1,94 @@
+#include "sharded_search_server.h"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+ShardedSearchServer::ShardedSearchServer(vector<unique_ptr<Shard>> shards)
+    : shards_(move(shards))
+{
+    if (shards_.empty()) {
+        throw invalid_argument("Sharded server needs at least one shard"s);
+    }
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    if (document_id < 0) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    GetShard(document_id).AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_id >= 0) {
+        GetShard(document_id).RemoveDocument(document_id);
+    }
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    vector<TermStatistics> shard_statistics(shards_.size());
+    transform(execution::par, shards_.begin(), shards_.end(), shard_statistics.begin(), [raw_query](const auto& shard) {
+        return shard->GetTermStatistics(raw_query);
+    });
+    TermStatistics statistics;
+    for (const TermStatistics& shard : shard_statistics) {
+        statistics.document_count += shard.document_count;
+        for (const auto& [word, document_freq] : shard.document_freqs) {
+            statistics.document_freqs[word] += document_freq;
+        }
+    }
+
+    vector<vector<Document>> shard_documents(shards_.size());
+    transform(execution::par, shards_.begin(), shards_.end(), shard_documents.begin(), [&](const auto& shard) {
+        return shard->FindTopDocuments(raw_query, status, statistics);
+    });
+    vector<Document> documents;
+    for (const auto& shard : shard_documents) {
+        documents.insert(documents.end(), shard.begin(), shard.end());
+    }
+    sort(documents.begin(), documents.end(), IsMoreRelevant);
+    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return documents;
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+ShardMatchReturn ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    if (document_id < 0) {
+        throw out_of_range("неверный id"s);
+    }
+    return GetShard(document_id).MatchDocument(raw_query, document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    return transform_reduce(shards_.begin(), shards_.end(), 0, plus<>{}, [](const auto& shard) {
+        return shard->GetDocumentCount();
+    });
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+Shard& ShardedSearchServer::GetShard(int document_id) const {
+    return *shards_[document_id % shards_.size()];
+}
+
+vector<unique_ptr<Shard>> MakeLocalShards(size_t shard_count, const string& stop_words_text) {
+    vector<unique_ptr<Shard>> shards;
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(make_unique<LocalShard>(stop_words_text));
+    }
+    return shards;
+}
+
+vector<unique_ptr<Shard>> MakeProcessShards(size_t shard_count, const string& executable, const string& stop_words_text) {
+    vector<unique_ptr<Shard>> shards;
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(make_unique<ProcessShard>(executable, stop_words_text));
+    }
+    return shards;
+}
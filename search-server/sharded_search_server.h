@@ -0,0 +1,38 @@
+#pragma once
+#include "search_server.h"
+#include "shard.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Partitions documents across shards by id. Queries are scattered to every shard in two
+// rounds: the first gathers term statistics so that all shards rank with the same IDF,
+// the second collects each shard's top documents, which are merged into the global top.
+class ShardedSearchServer {
+public:
+    explicit ShardedSearchServer(vector<unique_ptr<Shard>> shards);
+
+    void AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status) const;
+
+    vector<Document> FindTopDocuments(string_view raw_query) const;
+
+    ShardMatchReturn MatchDocument(string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+
+private:
+    vector<unique_ptr<Shard>> shards_;
+
+    Shard& GetShard(int document_id) const;
+};
+
+vector<unique_ptr<Shard>> MakeLocalShards(size_t shard_count, const string& stop_words_text);
+
+// every shard runs in its own shard_server process
+vector<unique_ptr<Shard>> MakeProcessShards(size_t shard_count, const string& executable, const string& stop_words_text);
@@ -0,0 +1,16 @@
+#include "stop_words.h"
+
+void StopWords::Build(const vector<string_view>& words) {
+    words_.resize(words.size());
+    hashes_.resize(words.size());
+    slots_.assign(GetStopWordTableSize(words.size()), 0);
+    size_t size = 0;
+    for (const string_view word : words) {
+        stop_words_detail::Insert(words_, hashes_, slots_, slots_.size(), size, word);
+        if (!word.empty()) {
+            length_mask_ |= GetStopWordLengthBit(word.size());
+        }
+    }
+    words_.resize(size);
+    hashes_.resize(size);
+}
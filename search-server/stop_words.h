@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// FNV-1a
+constexpr uint64_t HashStopWord(string_view word) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// one bit per word length, lengths from 63 on share the last one
+constexpr uint64_t GetStopWordLengthBit(size_t length) {
+    return uint64_t{1} << min(length, size_t{63});
+}
+
+// a power of two with at most half of the slots used
+constexpr size_t GetStopWordTableSize(size_t word_count) {
+    size_t size = 2;
+    while (size < word_count * 2) {
+        size *= 2;
+    }
+    return size;
+}
+
+namespace stop_words_detail {
+
+// Open addressing with linear probing. A slot holds the position of its word plus one, 0 marks an empty slot.
+// Shared by the compile-time and the run-time table, so both are laid out and probed the same way.
+template <typename Words, typename Hashes, typename Slots>
+constexpr bool Contains(const Words& words, const Hashes& hashes, const Slots& slots, size_t slot_count, string_view word) {
+    const uint64_t hash = HashStopWord(word);
+    const size_t mask = slot_count - 1;
+    for (size_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+        const uint32_t index = slots[i] - 1;
+        if (hashes[index] == hash && string_view(words[index]) == word) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Words, typename Hashes, typename Slots>
+constexpr void Insert(Words& words, Hashes& hashes, Slots& slots, size_t slot_count, size_t& size, string_view word) {
+    if (word.empty()) {
+        return;
+    }
+    const uint64_t hash = HashStopWord(word);
+    const size_t mask = slot_count - 1;
+    size_t i = hash & mask;
+    for (; slots[i] != 0; i = (i + 1) & mask) {
+        const uint32_t index = slots[i] - 1;
+        if (hashes[index] == hash && string_view(words[index]) == word) {
+            return;
+        }
+    }
+    words[size] = word;
+    hashes[size] = hash;
+    slots[i] = static_cast<uint32_t>(++size);
+}
+
+}  // namespace stop_words_detail
+
+// A stop word table built at compile time:
+//     constexpr auto stop_words = MakeStaticStopWords("and"sv, "in"sv, "the"sv);
+//     SearchServer search_server(stop_words);
+template <size_t N>
+class StaticStopWords {
+public:
+    constexpr explicit StaticStopWords(const array<string_view, N>& words) {
+        for (const string_view word : words) {
+            stop_words_detail::Insert(words_, hashes_, slots_, slots_.size(), size_, word);
+            if (!word.empty()) {
+                length_mask_ |= GetStopWordLengthBit(word.size());
+            }
+        }
+    }
+
+    constexpr bool Contains(string_view word) const {
+        return (length_mask_ & GetStopWordLengthBit(word.size())) != 0
+            && stop_words_detail::Contains(words_, hashes_, slots_, slots_.size(), word);
+    }
+
+    constexpr size_t size() const {
+        return size_;
+    }
+
+    constexpr const string_view* begin() const {
+        return words_.data();
+    }
+
+    constexpr const string_view* end() const {
+        return words_.data() + size_;
+    }
+
+private:
+    friend class StopWords;
+
+    array<string_view, N> words_{};
+    array<uint64_t, N> hashes_{};
+    array<uint32_t, GetStopWordTableSize(N)> slots_{};
+    size_t size_ = 0;
+    uint64_t length_mask_ = 0;
+};
+
+template <typename... Words>
+constexpr auto MakeStaticStopWords(Words... words) {
+    return StaticStopWords<sizeof...(Words)>(array<string_view, sizeof...(Words)>{string_view(words)...});
+}
+
+// Hashed stop word set, empty and repeated words are dropped. Most tokens are rejected by
+// their length alone, the rest take one hash and usually a single probe.
+class StopWords {
+public:
+    template <typename StringContainer>
+    explicit StopWords(const StringContainer& words) {
+        Build(vector<string_view>(std::begin(words), std::end(words)));
+    }
+
+    // takes the table built at compile time as it is
+    template <size_t N>
+    explicit StopWords(const StaticStopWords<N>& words)
+        : words_(words.begin(), words.end())
+        , hashes_(words.hashes_.begin(), words.hashes_.begin() + words.size())
+        , slots_(words.slots_.begin(), words.slots_.end())
+        , length_mask_(words.length_mask_) {
+    }
+
+    bool Contains(string_view word) const {
+        return (length_mask_ & GetStopWordLengthBit(word.size())) != 0
+            && stop_words_detail::Contains(words_, hashes_, slots_, slots_.size(), word);
+    }
+
+    size_t size() const {
+        return words_.size();
+    }
+
+    vector<string>::const_iterator begin() const {
+        return words_.begin();
+    }
+
+    vector<string>::const_iterator end() const {
+        return words_.end();
+    }
+
+private:
+    void Build(const vector<string_view>& words);
+
+    vector<string> words_;
+    vector<uint64_t> hashes_;
+    vector<uint32_t> slots_;
+    uint64_t length_mask_ = 0;
+};
@@ -1,7 +1,9 @@
 #include "string_processing.h"
 
-vector<string_view> SplitIntoWords(string_view text) {
-    vector<string_view> words;
+namespace {
+
+template <typename Words>
+void AppendWords(string_view text, Words& words) {
     while (true) {
         const auto space = text.find(' ');
         words.push_back(text.substr(0, space));
@@ -11,5 +13,18 @@ vector<string_view> SplitIntoWords(string_view text) {
             text.remove_prefix(space + 1);
         }
     }
+}
+
+}  // namespace
+
+vector<string_view> SplitIntoWords(string_view text) {
+    vector<string_view> words;
+    AppendWords(text, words);
+    return words;
+}
+
+pmr::vector<string_view> SplitIntoWords(string_view text, pmr::memory_resource* resource) {
+    pmr::vector<string_view> words(resource);
+    AppendWords(text, words);
     return words;
 }
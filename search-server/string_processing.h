@@ -4,11 +4,14 @@
 #include <set>
 #include <string_view>
 #include <iostream>
+#include <memory_resource>
 
 using namespace std;
 
 vector<string_view> SplitIntoWords(string_view text);
 
+pmr::vector<string_view> SplitIntoWords(string_view text, pmr::memory_resource* resource);
+
 template <typename StringContainer>
 set<string, less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     set<string, less<>> non_empty_strings;